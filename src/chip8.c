@@ -1,17 +1,25 @@
 #include "./chip8.h"
+#include "./chip8_ops.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 // intialzies the passed in Chip8 struct
+// decoded is set without being freed, a machine with a predecode cache has to
+// drop it with chip8_disable_predecode before being initialized again
 void chip8_init(Chip8* chip8) {
     chip8_init_memory(chip8);
     chip8_init_registers(chip8);
     chip8_load_font(chip8);
+    chip8_init_dispatch();
     chip8->pc = 0x200;  
     chip8->top = 0;      
-    
+    chip8->decoded = NULL;
+    chip8->fast_forward = 0;
+    chip8->skipped_cycles = 0;
+    chip8->idle_miss = 0xFFFF;
 }
 
 // intializing emulator memory
@@ -22,6 +30,8 @@ void chip8_init_memory(Chip8* chip8) {
         chip8->memory[i] = 0;
     }
     memset(chip8->display, 0x00000000, sizeof(chip8->display));
+    // nothing has been shown yet
+    chip8->dirty_rows = 0xFFFFFFFF;
 }
 
 // initializing emulator registers
@@ -30,36 +40,40 @@ void chip8_init_memory(Chip8* chip8) {
 void chip8_init_registers(Chip8* chip8) {
     for (int i = 0; i < 16; i++) {
         chip8->V[i] = 0;
+        chip8->stack[i] = 0;
     }
+    chip8->I = 0;
+    chip8->delay_timer = 0;
+    chip8->sound_timer = 0;
+    chip8->keys = 0;
+    chip8->key_wait = CHIP8_KEY_WAIT_NONE;
+    chip8->key_wait_key = 0;
+    chip8_seed(chip8, 0);
 }
 
+// font data, each char is 5 bytes
+const uint8_t chip8_font[CHIP8_FONT_SIZE] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
 // initalize memory location 050 - 09F to font data
-// each char is 5 bytes
 void chip8_load_font(Chip8* chip8) {
-    // declare font 
-    uint8_t font_data[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    // loop through memory and set memory starting at 0x050 to specific font
-    for (int i = 0; i < sizeof(font_data); i++) {
-        chip8->memory[0x050 + i] = font_data[i];
-    }
+    memcpy(&chip8->memory[CHIP8_FONT_START], chip8_font, sizeof(chip8_font));
 }
 
 // loading the rom into a given Chip8 memory
@@ -89,27 +103,576 @@ void load_rom(Chip8* chip8, const char* filename) {
     // write the file contents to Chip8 memory starting at 0x200
     fread(&chip8->memory[0x200], 1, size, file);
     fclose(file);
+
+    // anything predecoded before the load is stale now
+    chip8_invalidate_code(chip8, 0x200, size);
+}
+
+// seed the CXNN generator
+// the seed goes through splitmix64 first so nearby seeds give unrelated sequences
+void chip8_seed(Chip8* chip8, uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+
+    // xorshift gets stuck on 0
+    uint32_t state = (uint32_t)z ^ (uint32_t)(z >> 32);
+    chip8->rng = state ? state : 1;
+}
+
+// groups of 8 have a fixed trip count, which -O2's vectorizer cost model wants
+void chip8_random_fill(uint32_t* restrict states, uint8_t* restrict out, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            out[i + j] = chip8_random_next(&states[i + j]);
+        }
+    }
+    for (; i < count; i++) {
+        out[i] = chip8_random_next(&states[i]);
+    }
 }
 
 // stack push function
+// the stack index wraps at 16 so a runaway ROM can't write past the stack
 void chip8_push(Chip8* chip8, uint16_t value) {
-    // can do stack check here
-    chip8->stack[chip8->top] = value;
+    chip8->stack[chip8->top & 0xF] = value;
     chip8->top++;
 }
 
 // stack pop function
 uint16_t chip8_pop(Chip8* chip8) {
-    // can do stack check here
     chip8->top--;
-    return chip8->stack[chip8->top];
+    return chip8->stack[chip8->top & 0xF];
+}
+
+// decrement the delay and sound timers
+// called once per 60hz frame
+void chip8_tick_timers(Chip8* chip8) {
+    if (chip8->delay_timer > 0) {
+        chip8->delay_timer--;
+    }
+    if (chip8->sound_timer > 0) {
+        chip8->sound_timer--;
+    }
+}
+
+// fetch, decode and execute a single instruction
+// returns CHIP8_DRAW after a draw so the caller can wait for the frame refresh,
+// and CHIP8_KEY_WAIT (with pc left on the FX0A) until a key has gone down and up
+Chip8Status chip8_step(Chip8* chip8) {
+    // fetch
+    uint16_t opcode = FETCH_OPCODE();
+
+    // increment program counter
+    chip8->pc += 2;
+
+    // decode and execute
+    switch (opcode & 0xF000) {
+        // clear and return
+        case 0x0000:
+            switch (opcode & 0x00FF) {
+                case 0x00E0: return op_00e0(chip8, opcode);
+                case 0x00EE: return op_00ee(chip8, opcode);
+            }
+            break;
+
+        case 0x1000: return op_1nnn(chip8, opcode);
+        case 0x2000: return op_2nnn(chip8, opcode);
+        case 0x3000: return op_3xnn(chip8, opcode);
+        case 0x4000: return op_4xnn(chip8, opcode);
+        case 0x5000: return op_5xy0(chip8, opcode);
+        case 0x6000: return op_6xnn(chip8, opcode);
+        case 0x7000: return op_7xnn(chip8, opcode);
+
+        // logical instructions
+        case 0x8000:
+            switch (EXTRACT_N(opcode)) {
+                case 0x0000: return op_8xy0(chip8, opcode);
+                case 0x0001: return op_8xy1(chip8, opcode);
+                case 0x0002: return op_8xy2(chip8, opcode);
+                case 0x0003: return op_8xy3(chip8, opcode);
+                case 0x0004: return op_8xy4(chip8, opcode);
+                case 0x0005: return op_8xy5(chip8, opcode);
+                case 0x0006: return op_8xy6(chip8, opcode);
+                case 0x0007: return op_8xy7(chip8, opcode);
+                case 0x000E: return op_8xye(chip8, opcode);
+            }
+            break;
+
+        case 0x9000: return op_9xy0(chip8, opcode);
+        case 0xA000: return op_annn(chip8, opcode);
+        case 0xB000: return op_bnnn(chip8, opcode);
+        case 0xC000: return op_cxnn(chip8, opcode);
+        case 0xD000: return op_dxyn(chip8, opcode);
+
+        // skip if key
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x009E: return op_ex9e(chip8, opcode);
+                case 0x00A1: return op_exa1(chip8, opcode);
+            }
+            break;
+
+        // timers, keys and memory
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0007: return op_fx07(chip8, opcode);
+                case 0x000A: return op_fx0a(chip8, opcode);
+                case 0x0015: return op_fx15(chip8, opcode);
+                case 0x0018: return op_fx18(chip8, opcode);
+                case 0x001E: return op_fx1e(chip8, opcode);
+                case 0x0029: return op_fx29(chip8, opcode);
+                case 0x0033: return op_fx33(chip8, opcode);
+                case 0x0055: return op_fx55(chip8, opcode);
+                case 0x0065: return op_fx65(chip8, opcode);
+            }
+            break;
+    }
+
+    return CHIP8_OK;
+}
+
+// run up to the given number of cycles with the switch interpreter
+// stops early on a draw or key wait, the number of instructions
+// actually executed is written to executed (if not NULL)
+Chip8Status chip8_run_cycles_switch(Chip8* chip8, int cycles, int* executed) {
+    Chip8Status status = CHIP8_BUDGET;
+    int i = chip8->fast_forward ? chip8_skip_idle(chip8, cycles) : 0;
+
+    while (i < cycles) {
+        Chip8Status s = chip8_step(chip8);
+
+        if (s != CHIP8_OK) {
+            // a key wait doesn't execute anything
+            // a draw does, then ends the cycles for the display wait quirk
+            if (s == CHIP8_DRAW) {
+                i++;
+            }
+            status = s;
+            break;
+        }
+        i++;
+    }
+
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+}
+
+// handler functions in CHIP8_OPS order
+#define CHIP8_OP_FN(name, fn) fn,
+static Chip8Status (*const op_handlers[CHIP8_OP_COUNT])(Chip8*, uint16_t) = {
+    CHIP8_OPS(CHIP8_OP_FN)
+};
+#undef CHIP8_OP_FN
+
+// handler names in CHIP8_OPS order
+#define CHIP8_OP_NAME(name, fn) #name,
+static const char* const op_names[CHIP8_OP_COUNT] = {
+    CHIP8_OPS(CHIP8_OP_NAME)
+};
+#undef CHIP8_OP_NAME
+
+// every 16-bit opcode resolved to its handler index
+// filled in once by chip8_init_dispatch
+static uint8_t op_table[65536];
+static pthread_once_t op_table_once = PTHREAD_ONCE_INIT;
+
+static void build_op_table(void) {
+    for (int opcode = 0; opcode < 65536; opcode++) {
+        op_table[opcode] = chip8_decode_op(opcode);
+    }
+}
+
+// build the opcode to handler table
+// called from chip8_init, so it is ready before any instance runs, pthread_once
+// makes machines initialized on several threads at once wait for the one build
+void chip8_init_dispatch(void) {
+    pthread_once(&op_table_once, build_op_table);
+}
+
+// handler index of an opcode, same numbering as CHIP8_OPS
+int chip8_decode(uint16_t opcode) {
+    return op_table[opcode];
+}
+
+// name of a handler index, e.g. "8XY4"
+const char* chip8_op_name(int op) {
+    return op >= 0 && op < CHIP8_OP_COUNT ? op_names[op] : "?";
+}
+
+// the probe steps at most this many instructions waiting for a loop to come round
+#define IDLE_PROBE 32
+
+// everything an instruction can change but pc, memory and the display
+typedef struct IdleRegs {
+    uint16_t stack[16];
+    uint32_t rng;
+    uint16_t I;
+    uint8_t V[16];
+    uint8_t top;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+} IdleRegs;
+
+static void idle_regs(const Chip8* chip8, IdleRegs* regs) {
+    // zeroed first so the padding compares equal
+    memset(regs, 0, sizeof(*regs));
+    memcpy(regs->stack, chip8->stack, sizeof(regs->stack));
+    regs->rng = chip8->rng;
+    regs->I = chip8->I;
+    memcpy(regs->V, chip8->V, sizeof(regs->V));
+    regs->top = chip8->top;
+    regs->delay_timer = chip8->delay_timer;
+    regs->sound_timer = chip8->sound_timer;
+}
+
+// instructions read ahead of pc looking for the jump back that closes a loop
+#define IDLE_SCAN 8
+
+// a loop is only probed with this many turns of it in the budget, the probe
+// spends a turn or two proving it idle, below this there is too little left to skip
+#define IDLE_MIN_TURNS 4
+
+// a look at the code before stepping anything, which most of the time rules
+// pc out as the start of an idle loop for the cost of a few loads
+// a candidate jumps back to pc or before soon after it, with nothing on the way
+// that stores, draws, waits or calls, and isn't the loop last found busy
+// loops too long for IDLE_MIN_TURNS turns in cycles aren't looked for
+// returns 1 and where the loop jumps back to if pc is a candidate
+static int idle_candidate(const Chip8* chip8, int cycles, uint16_t* loop) {
+    uint16_t pc = chip8->pc;
+    int limit = cycles / IDLE_MIN_TURNS < IDLE_SCAN ? cycles / IDLE_MIN_TURNS : IDLE_SCAN;
+    for (int n = 0; n < limit; n++) {
+        uint16_t addr = (pc + 2 * n) & 0xFFF;
+        uint16_t opcode = (chip8->memory[addr] << 8) | chip8->memory[(addr + 1) & 0xFFF];
+        switch (op_table[opcode]) {
+            case CHIP8_OP_1NNN:
+                *loop = EXTRACT_NNN(opcode);
+                if (*loop <= pc) {
+                    int length = (addr - *loop) / 2 + 1;
+                    return *loop != chip8->idle_miss && length <= limit;
+                }
+                break;
+            case CHIP8_OP_INVALID:
+            case CHIP8_OP_00E0:
+            case CHIP8_OP_00EE:
+            case CHIP8_OP_2NNN:
+            case CHIP8_OP_BNNN:
+            case CHIP8_OP_DXYN:
+            case CHIP8_OP_FX0A:
+            case CHIP8_OP_FX33:
+            case CHIP8_OP_FX55:
+                return 0;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+// step until pc comes back round, then compare the registers with the turn before
+// the first turn can still change them, F007 picks up the newly ticked timer,
+// so a loop gets a few turns to settle within the probe
+int chip8_skip_idle(Chip8* chip8, int cycles) {
+    uint16_t loop;
+    if (!idle_candidate(chip8, cycles, &loop)) {
+        return 0;
+    }
+
+    uint16_t start = chip8->pc;
+    IdleRegs before, after;
+    int i = 0;
+    int turn = 0;
+    int turns = 0;
+
+    idle_regs(chip8, &before);
+    while (i < cycles && i < IDLE_PROBE) {
+        // stores, draws and key waits are left to the interpreter,
+        // the loop has been left or never was one
+        switch (op_table[FETCH_OPCODE()]) {
+            case CHIP8_OP_00E0:
+            case CHIP8_OP_DXYN:
+            case CHIP8_OP_FX0A:
+            case CHIP8_OP_FX33:
+            case CHIP8_OP_FX55:
+                return i;
+            default:
+                break;
+        }
+        chip8_step(chip8);
+        i++;
+        turn++;
+        if (chip8->pc != start) {
+            continue;
+        }
+
+        idle_regs(chip8, &after);
+        if (memcmp(&before, &after, sizeof(before)) == 0) {
+            // every turn from here on is the same as this one
+            int skip = (cycles - i) / turn * turn;
+            chip8->skipped_cycles += skip;
+            return i + skip;
+        }
+        before = after;
+        turn = 0;
+
+        // still changing after it had a turn to settle, it's doing work, a
+        // counting delay loop or a scan, so it isn't worth probing again
+        if (++turns == 2) {
+            chip8->idle_miss = loop;
+            return i;
+        }
+    }
+    return i;
+}
+
+// run up to the given number of cycles with the table interpreter
+// one load from the table and one indirect call per instruction,
+// otherwise the same as chip8_run_cycles_switch
+Chip8Status chip8_run_cycles_table(Chip8* chip8, int cycles, int* executed) {
+    Chip8Status status = CHIP8_BUDGET;
+    int i = chip8->fast_forward ? chip8_skip_idle(chip8, cycles) : 0;
+
+    while (i < cycles) {
+        uint16_t opcode = FETCH_OPCODE();
+        chip8->pc += 2;
+        Chip8Status s = op_handlers[op_table[opcode]](chip8, opcode);
+
+        if (s != CHIP8_OK) {
+            if (s == CHIP8_DRAW) {
+                i++;
+            }
+            status = s;
+            break;
+        }
+        i++;
+    }
+
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+}
+
+// run up to the given number of cycles with the direct threaded interpreter
+// every handler label ends in its own fetch and indirect jump, so the branch predictor
+// gets one jump site per instruction instead of the single one in the switch
+// the handler bodies are the same inline functions the other modes use
+Chip8Status chip8_run_cycles_goto(Chip8* chip8, int cycles, int* executed) {
+#if defined(__GNUC__)
+    #define CHIP8_OP_LABEL(name, fn) &&do_##name,
+    static void* const labels[CHIP8_OP_COUNT] = {
+        CHIP8_OPS(CHIP8_OP_LABEL)
+    };
+    #undef CHIP8_OP_LABEL
+
+    Chip8Status status = CHIP8_BUDGET;
+    uint16_t opcode;
+    int i = chip8->fast_forward ? chip8_skip_idle(chip8, cycles) : 0;
+
+    // fetch the next instruction and jump straight to its handler
+    #define DISPATCH() \
+        do { \
+            if (i >= cycles) goto done; \
+            opcode = FETCH_OPCODE(); \
+            chip8->pc += 2; \
+            goto *labels[op_table[opcode]]; \
+        } while (0)
+
+    // one label per handler, stops on anything other than CHIP8_OK
+    #define CHIP8_OP_BODY(name, fn) \
+        do_##name: \
+            status = fn(chip8, opcode); \
+            if (status != CHIP8_OK) goto stop; \
+            i++; \
+            DISPATCH();
+
+    DISPATCH();
+    CHIP8_OPS(CHIP8_OP_BODY)
+
+    #undef CHIP8_OP_BODY
+    #undef DISPATCH
+
+stop:
+    // a key wait doesn't execute anything, a draw does
+    if (status == CHIP8_DRAW) {
+        i++;
+    }
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+
+done:
+    if (executed) {
+        *executed = i;
+    }
+    return CHIP8_BUDGET;
+#else
+    // no computed goto, fall back to the table
+    return chip8_run_cycles_table(chip8, cycles, executed);
+#endif
+}
+
+// allocate the predecode cache, every entry starts undecoded
+void chip8_enable_predecode(Chip8* chip8) {
+    if (chip8->decoded) {
+        return;
+    }
+    chip8->decoded = malloc(4096 * sizeof(Chip8Decoded));
+    if (chip8->decoded == NULL) {
+        fprintf(stderr, "failed to allocate predecode cache\n");
+        exit(1);
+    }
+    for (int i = 0; i < 4096; i++) {
+        chip8->decoded[i].op = CHIP8_UNDECODED;
+    }
+}
+
+void chip8_disable_predecode(Chip8* chip8) {
+    free(chip8->decoded);
+    chip8->decoded = NULL;
+}
+
+// mark memory as written so predecoded instructions over it are decoded again
+// an opcode is two bytes, so the one starting just before addr is dropped too
+void chip8_invalidate_code(Chip8* chip8, uint16_t addr, int len) {
+    if (chip8->decoded == NULL) {
+        return;
+    }
+    for (int i = -1; i < len; i++) {
+        chip8->decoded[(addr + i) & 0xFFF].op = CHIP8_UNDECODED;
+    }
+}
+
+// run up to the given number of cycles from the predecode cache
+// the fetch and table lookup only happen the first time an address runs,
+// after that each instruction is one 4 byte load and a jump to its handler
+// falls back to chip8_run_cycles_goto when the cache isn't enabled
+Chip8Status chip8_run_cycles_cached(Chip8* chip8, int cycles, int* executed) {
+    Chip8Decoded* decoded = chip8->decoded;
+    if (decoded == NULL) {
+        return chip8_run_cycles_goto(chip8, cycles, executed);
+    }
+
+    Chip8Status status = CHIP8_BUDGET;
+    int i = chip8->fast_forward ? chip8_skip_idle(chip8, cycles) : 0;
+
+#if defined(__GNUC__)
+    #define CHIP8_OP_LABEL(name, fn) &&cached_##name,
+    static void* const labels[CHIP8_OP_COUNT] = {
+        CHIP8_OPS(CHIP8_OP_LABEL)
+    };
+    #undef CHIP8_OP_LABEL
+
+    Chip8Decoded* d;
+
+    // look up the next instruction, decoding it on first use
+    #define DISPATCH() \
+        do { \
+            if (i >= cycles) goto done; \
+            d = &decoded[chip8->pc & 0xFFF]; \
+            if (d->op == CHIP8_UNDECODED) { \
+                d->opcode = FETCH_OPCODE(); \
+                d->op = op_table[d->opcode]; \
+            } \
+            chip8->pc += 2; \
+            goto *labels[d->op]; \
+        } while (0)
+
+    // the opcode is passed by value, so a store that invalidates d is safe
+    #define CHIP8_OP_BODY(name, fn) \
+        cached_##name: \
+            status = fn(chip8, d->opcode); \
+            if (status != CHIP8_OK) goto stop; \
+            i++; \
+            DISPATCH();
+
+    DISPATCH();
+    CHIP8_OPS(CHIP8_OP_BODY)
+
+    #undef CHIP8_OP_BODY
+    #undef DISPATCH
+
+stop:
+    if (status == CHIP8_DRAW) {
+        i++;
+    }
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+
+done:
+    status = CHIP8_BUDGET;
+#else
+    while (i < cycles) {
+        Chip8Decoded* d = &decoded[chip8->pc & 0xFFF];
+        if (d->op == CHIP8_UNDECODED) {
+            d->opcode = FETCH_OPCODE();
+            d->op = op_table[d->opcode];
+        }
+        chip8->pc += 2;
+        Chip8Status s = op_handlers[d->op](chip8, d->opcode);
+
+        if (s != CHIP8_OK) {
+            if (s == CHIP8_DRAW) {
+                i++;
+            }
+            status = s;
+            break;
+        }
+        i++;
+    }
+#endif
+
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+}
+
+// run up to the given number of cycles with the dispatch mode picked at build time
+Chip8Status chip8_run_cycles(Chip8* chip8, int cycles, int* executed) {
+#if CHIP8_DISPATCH == CHIP8_DISPATCH_TABLE
+    return chip8_run_cycles_table(chip8, cycles, executed);
+#elif CHIP8_DISPATCH == CHIP8_DISPATCH_GOTO
+    return chip8_run_cycles_goto(chip8, cycles, executed);
+#elif CHIP8_DISPATCH == CHIP8_DISPATCH_CACHED
+    return chip8_run_cycles_cached(chip8, cycles, executed);
+#else
+    return chip8_run_cycles_switch(chip8, cycles, executed);
+#endif
+}
+
+// run one 60hz frame
+// timers tick once, then up to cycles_per_frame instructions run
+Chip8Status chip8_run_frame(Chip8* chip8, int cycles_per_frame) {
+    chip8_tick_timers(chip8);
+    return chip8_run_cycles(chip8, cycles_per_frame, NULL);
+}
+
+// hash of the packed display
+// cheap enough to call every frame to see if the screen changed
+uint64_t chip8_display_hash(const Chip8* chip8) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int y = 0; y < 32; y++) {
+        hash ^= chip8->display[y];
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
 }
 
 // print display to terminal (for bug testing)
 void print_display(Chip8* chip8) {
     for (int y = 0; y < 32; y++) {
         for (int x = 0; x < 64; x++) {
-            printf("%d ", chip8->display[y][x] ? 1 : 0);
+            printf("%d ", (int)CHIP8_PIXEL(chip8, x, y));
         }
         printf("\n");
     }
@@ -1,6 +1,17 @@
+#ifndef CHIP8_H
 #define CHIP8_H
 #include <stdint.h>
 
+// predecoded instruction
+// one per memory address, filled the first time the address is executed
+typedef struct Chip8Decoded {
+    uint16_t opcode; // raw opcode, operands are pulled out of it by the handler
+    uint8_t op;      // handler index, CHIP8_UNDECODED until filled
+} Chip8Decoded;
+
+// handler index of a predecode entry that needs decoding
+#define CHIP8_UNDECODED 0xFF
+
 typedef struct Chip8 {
     // 4kb of memory
     uint8_t memory[4096];
@@ -36,23 +47,164 @@ typedef struct Chip8 {
     uint8_t sound_timer;
 
     // display buffer
-    // 2d array of unsigned 8-bit int
-    // 64 x 32
+    // one unsigned 64-bit int per row, 32 rows
+    // bit 63 is the leftmost pixel (x = 0), bit 0 the rightmost (x = 63)
     // 1 is white, 0 is black
-    uint32_t display[32][64];
+    uint64_t display[32];
+
+    // rows of the display changed since whoever shows it last looked, bit n for row n
+    // set by 00E0 and DXYN, and all at once when the display is replaced wholesale,
+    // cleared by the one consumer that presents the display (chip8_take_dirty_rows)
+    // not part of the machine's state, savestates and comparisons leave it out
+    uint32_t dirty_rows;
+
+    // keypad state
+    // bit n is set while key n is held down
+    uint16_t keys;
+
+    // FX0A progress, a Chip8KeyWait
+    // CHIP8_KEY_WAIT_NONE unless pc is on an FX0A that hasn't finished
+    uint8_t key_wait;
+    // the key FX0A saw go down, while it waits for it to come back up
+    uint8_t key_wait_key;
+
+    // random number generator state for CXNN
+    // xorshift32, never 0, set with chip8_seed
+    uint32_t rng;
+
+    // predecode cache, 4096 entries parallel to memory
+    // NULL unless chip8_enable_predecode was called
+    Chip8Decoded* decoded;
+
+    // set to skip idle loops, see chip8_skip_idle
+    uint8_t fast_forward;
+    // instructions skipped by it so far, counted in the executed totals too
+    uint64_t skipped_cycles;
+    // where the last loop shown not to be idle jumps back to, so it isn't probed again
+    uint16_t idle_miss;
 
 } Chip8;
 
+// dispatch modes for chip8_run_cycles
+// pick one at build time with -DCHIP8_DISPATCH=CHIP8_DISPATCH_TABLE (make DISPATCH=TABLE)
+// GOTO needs the GCC/Clang computed goto extension and falls back to TABLE without it
+// CACHED runs from the predecode cache and falls back to GOTO for instances without one
+#define CHIP8_DISPATCH_SWITCH 0
+#define CHIP8_DISPATCH_TABLE 1
+#define CHIP8_DISPATCH_GOTO 2
+#define CHIP8_DISPATCH_CACHED 3
+#ifndef CHIP8_DISPATCH
+#define CHIP8_DISPATCH CHIP8_DISPATCH_SWITCH
+#endif
+
+// read a single pixel out of the packed display, 1 if on
+#define CHIP8_PIXEL(chip8, x, y) (((chip8)->display[(y)] >> (63 - (x))) & 1)
+
+// 1 if any row changed since the dirty rows were last taken, the whole frame can be skipped otherwise
+static inline int chip8_display_changed(const Chip8* chip8) {
+    return chip8->dirty_rows != 0;
+}
+
+// the rows changed since the last call, which starts them over
+static inline uint32_t chip8_take_dirty_rows(Chip8* chip8) {
+    uint32_t rows = chip8->dirty_rows;
+    chip8->dirty_rows = 0;
+    return rows;
+}
+
+// reasons the interpreter stops
+typedef enum Chip8Status {
+    CHIP8_OK,       // instruction ran, keep going
+    CHIP8_DRAW,     // a sprite was drawn, wait for the next frame
+    CHIP8_KEY_WAIT, // FX0A is waiting for a key press
+    CHIP8_BUDGET,   // ran through the whole cycle budget
+} Chip8Status;
+
+// FX0A waits for a key to go down and then come back up, as on the COSMAC VIP,
+// so a key held across two FX0As isn't read twice
+typedef enum Chip8KeyWait {
+    CHIP8_KEY_WAIT_NONE,    // not waiting
+    CHIP8_KEY_WAIT_PRESS,   // no key is down yet
+    CHIP8_KEY_WAIT_RELEASE, // key_wait_key is down, waiting for it to come up
+} Chip8KeyWait;
+
+// 1 while a machine is stopped on FX0A and its keys can't move it on,
+// so a host can skip it without running the FX0A again
+static inline int chip8_key_blocked(const Chip8* chip8) {
+    switch (chip8->key_wait) {
+        case CHIP8_KEY_WAIT_PRESS: return chip8->keys == 0;
+        case CHIP8_KEY_WAIT_RELEASE: return (chip8->keys >> chip8->key_wait_key) & 1;
+        default: return 0;
+    }
+}
+
 // stack functions
 void chip8_push(Chip8* chip8, uint16_t value);
 uint16_t chip8_pop(Chip8* chip8);
 
+// the built in font, 16 chars of 5 bytes at 0x050 - 0x09F
+#define CHIP8_FONT_START 0x050
+#define CHIP8_FONT_SIZE 80
+extern const uint8_t chip8_font[CHIP8_FONT_SIZE];
+
 // chip8 init functions
+// chip8_init takes fresh memory, it can't tell an old predecode cache from garbage,
+// so a machine being initialized again needs chip8_disable_predecode first
 void chip8_init(Chip8* chip8);
 void chip8_init_memory(Chip8* chip8);
 void chip8_init_registers(Chip8* chip8);
 void chip8_load_font(Chip8* chip8);
 void load_rom(Chip8* chip8, const char* filename);
 
+// random number functions
+// every machine has its own generator, chip8_init seeds it with 0, so runs
+// repeat exactly unless a different seed is picked
+void chip8_seed(Chip8* chip8, uint64_t seed);
+// one step of count separate generators, out[i] gets the next byte of states[i]
+// a plain loop over arrays so it vectorizes, for engines that keep lanes apart
+void chip8_random_fill(uint32_t* restrict states, uint8_t* restrict out, int count);
+
+// interpreter functions
+// none of these touch the window, so they can run headless
+Chip8Status chip8_step(Chip8* chip8);
+Chip8Status chip8_run_cycles(Chip8* chip8, int cycles, int* executed);
+Chip8Status chip8_run_frame(Chip8* chip8, int cycles_per_frame);
+void chip8_tick_timers(Chip8* chip8);
+
+// every dispatch mode is always built so they can be benchmarked side by side
+// chip8_run_cycles calls the one picked by CHIP8_DISPATCH
+typedef Chip8Status (*Chip8RunFn)(Chip8* chip8, int cycles, int* executed);
+Chip8Status chip8_run_cycles_switch(Chip8* chip8, int cycles, int* executed);
+Chip8Status chip8_run_cycles_table(Chip8* chip8, int cycles, int* executed);
+Chip8Status chip8_run_cycles_goto(Chip8* chip8, int cycles, int* executed);
+Chip8Status chip8_run_cycles_cached(Chip8* chip8, int cycles, int* executed);
+
+// idle loop fast forward
+// every run function starts with chip8_skip_idle when fast_forward is set
+// nothing outside a machine changes during one run call (timers tick and keys
+// change between calls), so once a machine goes round a loop and comes back
+// exactly as it was, like F007 3X00 1NNN polling the delay timer or a 1NNN to
+// itself, it would go round it until the budget ran out
+// chip8_skip_idle looks for such a loop at pc, skips whole turns of it up to the
+// end of the budget and returns the instructions run and skipped, the machine
+// ends up just as if it had run them
+int chip8_skip_idle(Chip8* chip8, int cycles);
+
+// predecode cache functions
+// stores into memory through FX33 and FX55 invalidate the entries they overwrite
+void chip8_enable_predecode(Chip8* chip8);
+void chip8_disable_predecode(Chip8* chip8);
+void chip8_invalidate_code(Chip8* chip8, uint16_t addr, int len);
+
+// opcode table functions
+void chip8_init_dispatch(void);
+int chip8_decode(uint16_t opcode);
+const char* chip8_op_name(int op);
+
+// display functions
+uint64_t chip8_display_hash(const Chip8* chip8);
+
 // testing
-void print_display(Chip8* chip8);
\ No newline at end of file
+void print_display(Chip8* chip8);
+
+#endif
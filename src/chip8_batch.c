@@ -0,0 +1,162 @@
+#include "./chip8_batch.h"
+#include "./chip8_sched.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// one instance and everything the batch keeps for it
+// aligned so no two instances share a cache line
+typedef struct Chip8BatchSlot {
+    _Alignas(64) Chip8 chip8;
+    Chip8BatchResult result;
+    Chip8Sched sched; // the instance's clock, for chip8_batch_run_cycles
+} Chip8BatchSlot;
+
+struct Chip8Batch {
+    Chip8BatchSlot* slots;
+    int count;
+    Chip8RunFn run;
+};
+
+Chip8Batch* chip8_batch_create(int count, Chip8RunFn run) {
+    Chip8Batch* batch = malloc(sizeof(Chip8Batch));
+    if (batch == NULL) {
+        return NULL;
+    }
+
+    // sizeof a slot is a multiple of its alignment, so every slot starts a line
+    batch->slots = aligned_alloc(64, (size_t)count * sizeof(Chip8BatchSlot));
+    if (batch->slots == NULL) {
+        free(batch);
+        return NULL;
+    }
+    batch->count = count;
+    batch->run = run ? run : chip8_run_cycles;
+
+    for (int i = 0; i < count; i++) {
+        Chip8BatchSlot* slot = &batch->slots[i];
+        chip8_init(&slot->chip8);
+        if (batch->run == chip8_run_cycles_cached) {
+            chip8_enable_predecode(&slot->chip8);
+        }
+        slot->result.status = CHIP8_OK;
+        slot->result.executed = 0;
+        // cycles_per_tick comes with each run
+        chip8_sched_init(&slot->sched, 1);
+        slot->sched.display_wait = 0;
+        slot->sched.run = batch->run;
+    }
+
+    return batch;
+}
+
+void chip8_batch_destroy(Chip8Batch* batch) {
+    if (batch == NULL) {
+        return;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        chip8_disable_predecode(&batch->slots[i].chip8);
+    }
+    free(batch->slots);
+    free(batch);
+}
+
+// the file is only read once, then copied into the rest
+void chip8_batch_load_rom(Chip8Batch* batch, const char* filename) {
+    if (batch->count == 0) {
+        return;
+    }
+    Chip8* first = &batch->slots[0].chip8;
+    load_rom(first, filename);
+
+    for (int i = 1; i < batch->count; i++) {
+        Chip8* chip8 = &batch->slots[i].chip8;
+        memcpy(&chip8->memory[0x200], &first->memory[0x200], 4096 - 0x200);
+        chip8_invalidate_code(chip8, 0x200, 4096 - 0x200);
+    }
+}
+
+void chip8_batch_seed(Chip8Batch* batch, uint64_t seed) {
+    for (int i = 0; i < batch->count; i++) {
+        chip8_seed(&batch->slots[i].chip8, seed + i);
+    }
+}
+
+void chip8_batch_set_fast_forward(Chip8Batch* batch, int on) {
+    for (int i = 0; i < batch->count; i++) {
+        batch->slots[i].chip8.fast_forward = on != 0;
+    }
+}
+
+uint64_t chip8_batch_skipped_cycles(const Chip8Batch* batch) {
+    uint64_t total = 0;
+    for (int i = 0; i < batch->count; i++) {
+        total += batch->slots[i].chip8.skipped_cycles;
+    }
+    return total;
+}
+
+void chip8_batch_set_keys(Chip8Batch* batch, const uint16_t* keys) {
+    for (int i = 0; i < batch->count; i++) {
+        batch->slots[i].chip8.keys = keys[i];
+    }
+}
+
+uint64_t chip8_batch_run_frame(Chip8Batch* batch, int cycles_per_frame) {
+    return chip8_batch_run_frame_range(batch, 0, batch->count, cycles_per_frame);
+}
+
+uint64_t chip8_batch_run_cycles(Chip8Batch* batch, int cycles, int cycles_per_frame) {
+    return chip8_batch_run_cycles_range(batch, 0, batch->count, cycles, cycles_per_frame);
+}
+
+uint64_t chip8_batch_run_frame_range(Chip8Batch* batch, int begin, int end, int cycles_per_frame) {
+    uint64_t total = 0;
+
+    for (int i = begin; i < end; i++) {
+        Chip8BatchSlot* slot = &batch->slots[i];
+        chip8_tick_timers(&slot->chip8);
+        // nothing a frame could run changes for an instance stuck on FX0A
+        if (chip8_key_blocked(&slot->chip8)) {
+            slot->result.status = CHIP8_KEY_WAIT;
+            slot->result.executed = 0;
+            continue;
+        }
+        slot->result.status = batch->run(&slot->chip8, cycles_per_frame, &slot->result.executed);
+        total += slot->result.executed;
+    }
+
+    return total;
+}
+
+// each instance runs its whole budget before moving to the next,
+// so its memory stays in cache for the length of the run
+uint64_t chip8_batch_run_cycles_range(Chip8Batch* batch, int begin, int end, int cycles, int cycles_per_frame) {
+    uint64_t total = 0;
+
+    for (int i = begin; i < end; i++) {
+        Chip8BatchSlot* slot = &batch->slots[i];
+        slot->sched.cycles_per_tick = cycles_per_frame;
+
+        // an instance blocked on FX0A sits out the rest of the budget, its timers
+        // still ticking, the scheduler doesn't run it at all
+        slot->result.executed = (int)chip8_sched_run(&slot->sched, &slot->chip8, cycles);
+        slot->result.status = chip8_key_blocked(&slot->chip8) ? CHIP8_KEY_WAIT : CHIP8_BUDGET;
+        total += slot->result.executed;
+    }
+
+    return total;
+}
+
+int chip8_batch_count(const Chip8Batch* batch) {
+    return batch->count;
+}
+
+Chip8* chip8_batch_machine(Chip8Batch* batch, int index) {
+    return &batch->slots[index].chip8;
+}
+
+const Chip8BatchResult* chip8_batch_result(const Chip8Batch* batch, int index) {
+    return &batch->slots[index].result;
+}
@@ -0,0 +1,61 @@
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// many instance batch engine
+// owns N machines in one contiguous pool, each in its own cache line aligned slot,
+// and steps all of them per call, for agents, searches and regression runs
+// that need thousands of machines rather than one in a window
+
+typedef struct Chip8Batch Chip8Batch;
+
+// per instance output of the last run call
+typedef struct Chip8BatchResult {
+    Chip8Status status; // how the instance stopped, CHIP8_KEY_WAIT if blocked on FX0A
+    int executed;       // instructions executed by the last call
+} Chip8BatchResult;
+
+// count machines, all initialized with chip8_init
+// run is the interpreter used for every instance, NULL for chip8_run_cycles
+// chip8_run_cycles_cached turns on the predecode cache of every instance
+Chip8Batch* chip8_batch_create(int count, Chip8RunFn run);
+void chip8_batch_destroy(Chip8Batch* batch);
+
+// load the same ROM into every instance, exits on failure like load_rom
+void chip8_batch_load_rom(Chip8Batch* batch, const char* filename);
+
+// seed the CXNN generator of instance i with seed + i
+// instances start with the same seed, so without this they all run the same
+void chip8_batch_seed(Chip8Batch* batch, uint64_t seed);
+
+// turn idle loop fast forward on or off for every instance, see chip8_skip_idle
+void chip8_batch_set_fast_forward(Chip8Batch* batch, int on);
+// instructions fast forwarded across every instance so far
+uint64_t chip8_batch_skipped_cycles(const Chip8Batch* batch);
+
+// set the keypad bitmask of every instance, keys[i] goes to instance i
+void chip8_batch_set_keys(Chip8Batch* batch, const uint16_t* keys);
+
+// run every instance for one frame, same as chip8_run_frame on each
+// instances blocked on FX0A only have their timers ticked
+// returns the instructions executed across all instances
+uint64_t chip8_batch_run_frame(Chip8Batch* batch, int cycles_per_frame);
+
+// run every instance for cycles of emulated time on its own Chip8Sched, ignoring
+// the display wait, timers tick every cycles_per_frame cycles, carried across calls
+// instances blocked on FX0A stop early, the rest of their budget passes as
+// time, ticking their timers, without running them
+uint64_t chip8_batch_run_cycles(Chip8Batch* batch, int cycles, int cycles_per_frame);
+
+// the same for instances begin to end - 1 only
+// different ranges can run on different threads at the same time
+uint64_t chip8_batch_run_frame_range(Chip8Batch* batch, int begin, int end, int cycles_per_frame);
+uint64_t chip8_batch_run_cycles_range(Chip8Batch* batch, int begin, int end, int cycles, int cycles_per_frame);
+
+// access to a single instance
+int chip8_batch_count(const Chip8Batch* batch);
+Chip8* chip8_batch_machine(Chip8Batch* batch, int index);
+const Chip8BatchResult* chip8_batch_result(const Chip8Batch* batch, int index);
+
+#endif
@@ -0,0 +1,72 @@
+#include "./chip8_governor.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// part of each frame an unlimited budget aims to fill, the rest is slack for a
+// slow frame, the pacing spin and the other thread
+#define UNLIMITED_SHARE 0.75
+
+// unlimited budgets start small and are kept within these
+#define UNLIMITED_FIRST 1000
+#define UNLIMITED_MAX (1 << 28)
+
+void chip8_governor_init(Chip8Governor* governor, uint64_t ips, int hz) {
+    governor->ips = ips;
+    governor->hz = hz;
+    governor->frame = 0;
+    governor->budget = UNLIMITED_FIRST;
+    governor->rate = 0;
+    governor->executed = 0;
+    governor->run_seconds = 0;
+}
+
+int chip8_governor_next(Chip8Governor* governor) {
+    if (governor->ips != CHIP8_IPS_UNLIMITED) {
+        // every hz frames start on a whole second, so only the frame's place
+        // within its second matters and the products stay small however long it runs
+        uint64_t part = governor->frame % governor->hz;
+        uint64_t start = part * governor->ips / governor->hz;
+        uint64_t end = (part + 1) * governor->ips / governor->hz;
+        governor->budget = (int)(end - start);
+    }
+    else if (governor->rate > 0) {
+        // halfway to the budget the measured rate would fill, so one odd frame
+        // doesn't swing it
+        double target = governor->rate * UNLIMITED_SHARE / governor->hz;
+        double budget = (governor->budget + target) / 2;
+        if (budget < 1) {
+            budget = 1;
+        }
+        if (budget > UNLIMITED_MAX) {
+            budget = UNLIMITED_MAX;
+        }
+        governor->budget = (int)budget;
+    }
+    governor->frame++;
+    return governor->budget;
+}
+
+void chip8_governor_done(Chip8Governor* governor, uint64_t executed, double seconds) {
+    governor->executed += executed;
+    governor->run_seconds += seconds;
+
+    // a frame that spent most of its cycles stalled on FX0A says nothing about speed
+    if (governor->ips == CHIP8_IPS_UNLIMITED && seconds > 0 && executed * 2 >= (uint64_t)governor->budget) {
+        governor->rate = executed / seconds;
+    }
+}
+
+void chip8_governor_print(const Chip8Governor* governor, FILE* out) {
+    if (governor->frame == 0) {
+        return;
+    }
+    double seconds = (double)governor->frame / governor->hz;
+    if (governor->ips == CHIP8_IPS_UNLIMITED) {
+        fprintf(out, "instructions per second: unlimited");
+    }
+    else {
+        fprintf(out, "instructions per second: %llu", (unsigned long long)governor->ips);
+    }
+    fprintf(out, ", ran %.0f, running %.0f%% of the time\n",
+        governor->executed / seconds, 100 * governor->run_seconds / seconds);
+}
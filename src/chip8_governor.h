@@ -0,0 +1,47 @@
+#ifndef CHIP8_GOVERNOR_H
+#define CHIP8_GOVERNOR_H
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// instructions per second governor
+// hands out the cycles each 60hz frame runs for, a frame being one timer tick
+// at a set rate a frame is ips / hz cycles, which needn't be whole, so frame n
+// starts at cycle n * ips / hz rounded down and the remainders carry over, every
+// second runs exactly ips
+// unlimited runs as many as one core can, each frame's budget is sized from how
+// fast the ones before it ran to fill most of a frame's time
+
+// ips for as many as one core can run
+#define CHIP8_IPS_UNLIMITED 0
+
+// highest set rate, past it a frame's budget wouldn't fit an int
+#define CHIP8_IPS_MAX(hz) ((uint64_t)INT_MAX * (hz))
+
+typedef struct Chip8Governor {
+    uint64_t ips;   // target, or CHIP8_IPS_UNLIMITED
+    int hz;         // frames per second
+    uint64_t frame; // frames budgeted so far
+    int budget;     // cycles of the last frame handed out
+
+    // unlimited only, instructions per second of running time measured so far
+    double rate;
+
+    // for the report
+    uint64_t executed;
+    double run_seconds;
+} Chip8Governor;
+
+// ips is CHIP8_IPS_UNLIMITED or at most CHIP8_IPS_MAX(hz)
+void chip8_governor_init(Chip8Governor* governor, uint64_t ips, int hz);
+
+// cycles of emulated time for the next frame
+int chip8_governor_next(Chip8Governor* governor);
+
+// what the frame did with them, instructions executed and seconds it took to run
+void chip8_governor_done(Chip8Governor* governor, uint64_t executed, double seconds);
+
+// the rate asked for and the one reached over the frames so far
+void chip8_governor_print(const Chip8Governor* governor, FILE* out);
+
+#endif
@@ -0,0 +1,114 @@
+#include "./chip8_input.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MASK (CHIP8_INPUT_CAPACITY - 1)
+
+_Static_assert((CHIP8_INPUT_CAPACITY & MASK) == 0, "CHIP8_INPUT_CAPACITY must be a power of two");
+
+typedef struct Chip8KeyEvent {
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t pressed;
+} Chip8KeyEvent;
+
+// indices only ever grow, a slot is index & MASK
+struct Chip8Input {
+    // written by the producer
+    _Alignas(64) _Atomic uint32_t head;
+    uint32_t tail_seen; // producer's copy of tail
+
+    // written by the consumer
+    _Alignas(64) _Atomic uint32_t tail;
+    uint32_t head_seen; // consumer's copy of head
+    _Atomic uint64_t clock;
+
+    _Alignas(64) Chip8KeyEvent events[CHIP8_INPUT_CAPACITY];
+};
+
+Chip8Input* chip8_input_create(void) {
+    Chip8Input* input = aligned_alloc(64, sizeof(Chip8Input));
+    if (input == NULL) {
+        return NULL;
+    }
+    atomic_init(&input->head, 0);
+    atomic_init(&input->tail, 0);
+    atomic_init(&input->clock, 0);
+    input->tail_seen = 0;
+    input->head_seen = 0;
+    return input;
+}
+
+void chip8_input_destroy(Chip8Input* input) {
+    free(input);
+}
+
+int chip8_input_push(Chip8Input* input, uint64_t cycle, int key, int pressed) {
+    uint32_t head = atomic_load_explicit(&input->head, memory_order_relaxed);
+    if (head - input->tail_seen == CHIP8_INPUT_CAPACITY) {
+        input->tail_seen = atomic_load_explicit(&input->tail, memory_order_acquire);
+        if (head - input->tail_seen == CHIP8_INPUT_CAPACITY) {
+            return -1;
+        }
+    }
+
+    Chip8KeyEvent* event = &input->events[head & MASK];
+    event->cycle = cycle;
+    event->key = (uint8_t)(key & 0xF);
+    event->pressed = pressed != 0;
+    atomic_store_explicit(&input->head, head + 1, memory_order_release);
+    return 0;
+}
+
+uint64_t chip8_input_clock(const Chip8Input* input) {
+    return atomic_load_explicit(&input->clock, memory_order_relaxed);
+}
+
+int chip8_input_press(Chip8Input* input, int key, int pressed) {
+    return chip8_input_push(input, chip8_input_clock(input), key, pressed);
+}
+
+void chip8_input_set_clock(Chip8Input* input, uint64_t clock) {
+    atomic_store_explicit(&input->clock, clock, memory_order_relaxed);
+}
+
+// the oldest waiting event, NULL if there is none
+static const Chip8KeyEvent* peek(Chip8Input* input) {
+    uint32_t tail = atomic_load_explicit(&input->tail, memory_order_relaxed);
+    if (tail == input->head_seen) {
+        input->head_seen = atomic_load_explicit(&input->head, memory_order_acquire);
+        if (tail == input->head_seen) {
+            return NULL;
+        }
+    }
+    return &input->events[tail & MASK];
+}
+
+static void take(Chip8Input* input, Chip8* chip8, const Chip8KeyEvent* event) {
+    if (event->pressed) {
+        chip8->keys |= 1 << event->key;
+    }
+    else {
+        chip8->keys &= ~(1 << event->key);
+    }
+    uint32_t tail = atomic_load_explicit(&input->tail, memory_order_relaxed);
+    atomic_store_explicit(&input->tail, tail + 1, memory_order_release);
+}
+
+void chip8_input_apply(Chip8Input* input, Chip8* chip8) {
+    uint64_t clock = chip8_input_clock(input);
+    const Chip8KeyEvent* event;
+    while ((event = peek(input)) != NULL && event->cycle <= clock) {
+        take(input, chip8, event);
+    }
+}
+
+int chip8_input_next(Chip8Input* input, uint64_t* cycle) {
+    const Chip8KeyEvent* event = peek(input);
+    if (event == NULL) {
+        return 0;
+    }
+    *cycle = event->cycle;
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef CHIP8_INPUT_H
+#define CHIP8_INPUT_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// input queue
+// a single producer, single consumer lock free ring of key presses and releases,
+// each stamped with the cycle it takes effect at, feeding one machine
+// the producer (a window's key callback, a network thread, a script) pushes,
+// the thread running the machine drains the queue at cycle boundaries into the
+// keys bitmask, so the two never write the same memory
+// each side keeps its index on its own cache line and a cached copy of the other's,
+// so they only touch each other's line when the ring looks full or empty
+
+typedef struct Chip8Input Chip8Input;
+
+// slots in the ring, a push fails once this many events are waiting
+#define CHIP8_INPUT_CAPACITY 256
+
+Chip8Input* chip8_input_create(void);
+void chip8_input_destroy(Chip8Input* input);
+
+// producer side
+// queue a key going down or up at the given cycle
+// returns -1 if the ring is full, 0 otherwise
+int chip8_input_push(Chip8Input* input, uint64_t cycle, int key, int pressed);
+// the same stamped with the consumer's current cycle, so it lands as soon as possible
+int chip8_input_press(Chip8Input* input, int key, int pressed);
+// the machine's clock in cycles, as last published by the consumer
+uint64_t chip8_input_clock(const Chip8Input* input);
+
+// consumer side, usually a Chip8Sched, which stops the machine at each stamp
+// publish the machine's clock
+void chip8_input_set_clock(Chip8Input* input, uint64_t clock);
+// apply every event stamped at or before the clock to the machine's keys
+void chip8_input_apply(Chip8Input* input, Chip8* chip8);
+// the stamp of the oldest event still queued, returns 0 if there is none
+int chip8_input_next(Chip8Input* input, uint64_t* cycle);
+
+#endif
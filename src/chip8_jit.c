@@ -0,0 +1,742 @@
+#include "./chip8_jit.h"
+#include "./chip8_ops.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#define CHIP8_JIT_ENABLED 1
+#else
+#define CHIP8_JIT_ENABLED 0
+#endif
+
+// size of the executable code buffer, flushed when full
+#define JIT_CODE_SIZE (1 << 20)
+
+// longest block in instructions, keeps a block inside any sensible cycle budget
+#define JIT_MAX_BLOCK 64
+
+// worst case bytes for one block, checked before translating
+// no single instruction emits more than 64 bytes
+#define JIT_MAX_BLOCK_BYTES ((JIT_MAX_BLOCK + 2) * 64)
+
+// a translated block
+// takes the machine and a cycle budget of at least the block length, leaves pc at
+// the next instruction and returns how many instructions it executed
+typedef int (*Chip8Block)(Chip8* chip8, int budget);
+
+struct Chip8Jit {
+    // code memory, NULL when the jit is unavailable
+    // never writable and executable at once, it is read write while a block is
+    // emitted and read execute while blocks run
+    uint8_t* code;
+    size_t code_used;
+    int writable;
+
+    // block cache keyed by start address
+    Chip8Block blocks[4096];
+    uint8_t block_len[4096]; // instructions in the block at this address
+    uint8_t tried[4096];     // 1 once translation of this address was attempted
+    uint8_t covered[4096];   // 1 if this byte of memory is inside a translated block
+
+    uint64_t translated;
+};
+
+// x86-64 code emitter
+// the block gets the Chip8 pointer in rdi and the budget in esi (System V)
+// esi counts the budget down as the block runs, r8d keeps the starting budget
+// eax, ecx and edx are scratch
+// every memory operand is [rdi + disp32] into the Chip8 struct
+
+#define REG_EAX 0
+#define REG_ECX 1
+#define REG_EDX 2
+
+typedef struct Emitter {
+    uint8_t* p;
+} Emitter;
+
+static void emit8(Emitter* e, uint8_t byte) {
+    *e->p++ = byte;
+}
+
+static void emit16(Emitter* e, uint16_t value) {
+    emit8(e, value & 0xFF);
+    emit8(e, value >> 8);
+}
+
+static void emit32(Emitter* e, uint32_t value) {
+    emit16(e, value & 0xFFFF);
+    emit16(e, value >> 16);
+}
+
+// modrm for [rdi + disp32] with reg (or opcode extension) in the middle bits
+static void emit_mem(Emitter* e, int reg, size_t offset) {
+    emit8(e, 0x80 | (reg << 3) | 7);
+    emit32(e, (uint32_t)offset);
+}
+
+// offsets of the fields the blocks touch
+#define OFF_V(x) (offsetof(Chip8, V) + (x))
+#define OFF_PC offsetof(Chip8, pc)
+#define OFF_I offsetof(Chip8, I)
+#define OFF_DELAY offsetof(Chip8, delay_timer)
+#define OFF_SOUND offsetof(Chip8, sound_timer)
+#define OFF_KEYS offsetof(Chip8, keys)
+#define OFF_STACK offsetof(Chip8, stack)
+#define OFF_TOP offsetof(Chip8, top)
+
+// movzx reg, byte [rdi + offset]
+static void emit_load8(Emitter* e, int reg, size_t offset) {
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emit_mem(e, reg, offset);
+}
+
+// mov byte [rdi + offset], reg8
+static void emit_store8(Emitter* e, int reg, size_t offset) {
+    emit8(e, 0x88);
+    emit_mem(e, reg, offset);
+}
+
+// mov byte [rdi + offset], imm8
+static void emit_store8_imm(Emitter* e, size_t offset, uint8_t value) {
+    emit8(e, 0xC6);
+    emit_mem(e, 0, offset);
+    emit8(e, value);
+}
+
+// add byte [rdi + offset], imm8
+static void emit_add8_imm(Emitter* e, size_t offset, uint8_t value) {
+    emit8(e, 0x80);
+    emit_mem(e, 0, offset);
+    emit8(e, value);
+}
+
+// cmp byte [rdi + offset], imm8
+static void emit_cmp8_imm(Emitter* e, size_t offset, uint8_t value) {
+    emit8(e, 0x80);
+    emit_mem(e, 7, offset);
+    emit8(e, value);
+}
+
+// cmp byte [rdi + offset], reg8
+static void emit_cmp8(Emitter* e, size_t offset, int reg) {
+    emit8(e, 0x38);
+    emit_mem(e, reg, offset);
+}
+
+// movzx reg, word [rdi + offset]
+static void emit_load16(Emitter* e, int reg, size_t offset) {
+    emit8(e, 0x0F);
+    emit8(e, 0xB7);
+    emit_mem(e, reg, offset);
+}
+
+// mov word [rdi + offset], reg16
+static void emit_store16(Emitter* e, int reg, size_t offset) {
+    emit8(e, 0x66);
+    emit8(e, 0x89);
+    emit_mem(e, reg, offset);
+}
+
+// mov word [rdi + offset], imm16
+static void emit_store16_imm(Emitter* e, size_t offset, uint16_t value) {
+    emit8(e, 0x66);
+    emit8(e, 0xC7);
+    emit_mem(e, 0, offset);
+    emit16(e, value);
+}
+
+// mov reg, imm32
+static void emit_mov_imm(Emitter* e, int reg, uint32_t value) {
+    emit8(e, 0xB8 + reg);
+    emit32(e, value);
+}
+
+// 8-bit alu op al, cl, opcode is one of the ALU_* values
+#define ALU_ADD 0x00
+#define ALU_OR 0x08
+#define ALU_AND 0x20
+#define ALU_SUB 0x28
+#define ALU_XOR 0x30
+static void emit_alu8(Emitter* e, uint8_t alu) {
+    emit8(e, alu);
+    emit8(e, 0xC8);
+}
+
+// setcc dl
+#define CC_B 0x2  // carry set
+#define CC_AE 0x3 // carry clear
+#define CC_E 0x4
+#define CC_NE 0x5
+static void emit_setcc_dl(Emitter* e, uint8_t cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x90 | cc);
+    emit8(e, 0xC2);
+}
+
+// cmovcc eax, edx
+static void emit_cmov_eax_edx(Emitter* e, uint8_t cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x40 | cc);
+    emit8(e, 0xC2);
+}
+
+static void emit_ret(Emitter* e) {
+    emit8(e, 0xC3);
+}
+
+// VF = dl, the flag is written after the result like the interpreter does
+static void emit_result_and_flag(Emitter* e, int x) {
+    emit_store8(e, REG_EAX, OFF_V(x));
+    emit_store8(e, REG_EDX, OFF_V(0xF));
+}
+
+// instructions emit_simple can translate
+static int jit_simple(Chip8Op op) {
+    switch (op) {
+        case CHIP8_OP_6XNN:
+        case CHIP8_OP_7XNN:
+        case CHIP8_OP_8XY0:
+        case CHIP8_OP_8XY1:
+        case CHIP8_OP_8XY2:
+        case CHIP8_OP_8XY3:
+        case CHIP8_OP_8XY4:
+        case CHIP8_OP_8XY5:
+        case CHIP8_OP_8XY6:
+        case CHIP8_OP_8XY7:
+        case CHIP8_OP_8XYE:
+        case CHIP8_OP_ANNN:
+        case CHIP8_OP_FX1E:
+        case CHIP8_OP_FX07:
+        case CHIP8_OP_FX15:
+        case CHIP8_OP_FX18:
+        case CHIP8_OP_FX29:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// emit one straight line instruction, op must pass jit_simple
+static void emit_simple(Emitter* e, Chip8Op op, uint16_t opcode) {
+    int x = EXTRACT_X(opcode);
+    int y = EXTRACT_Y(opcode);
+
+    switch (op) {
+        case CHIP8_OP_6XNN:
+            emit_store8_imm(e, OFF_V(x), EXTRACT_NN(opcode));
+            return;
+
+        case CHIP8_OP_7XNN:
+            emit_add8_imm(e, OFF_V(x), EXTRACT_NN(opcode));
+            return;
+
+        case CHIP8_OP_8XY0:
+            emit_load8(e, REG_EAX, OFF_V(y));
+            emit_store8(e, REG_EAX, OFF_V(x));
+            return;
+
+        // or, and, xor clear VF
+        case CHIP8_OP_8XY1:
+        case CHIP8_OP_8XY2:
+        case CHIP8_OP_8XY3:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_load8(e, REG_ECX, OFF_V(y));
+            emit_alu8(e, op == CHIP8_OP_8XY1 ? ALU_OR : op == CHIP8_OP_8XY2 ? ALU_AND : ALU_XOR);
+            emit_store8(e, REG_EAX, OFF_V(x));
+            emit_store8_imm(e, OFF_V(0xF), 0);
+            return;
+
+        // VF is the carry out
+        case CHIP8_OP_8XY4:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_load8(e, REG_ECX, OFF_V(y));
+            emit_alu8(e, ALU_ADD);
+            emit_setcc_dl(e, CC_B);
+            emit_result_and_flag(e, x);
+            return;
+
+        // VF is 1 when there was no borrow
+        case CHIP8_OP_8XY5:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_load8(e, REG_ECX, OFF_V(y));
+            emit_alu8(e, ALU_SUB);
+            emit_setcc_dl(e, CC_AE);
+            emit_result_and_flag(e, x);
+            return;
+
+        case CHIP8_OP_8XY7:
+            emit_load8(e, REG_EAX, OFF_V(y));
+            emit_load8(e, REG_ECX, OFF_V(x));
+            emit_alu8(e, ALU_SUB);
+            emit_setcc_dl(e, CC_AE);
+            emit_result_and_flag(e, x);
+            return;
+
+        // shifts put the bit shifted out in VF
+        case CHIP8_OP_8XY6:
+        case CHIP8_OP_8XYE:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0xD0);
+            emit8(e, op == CHIP8_OP_8XY6 ? 0xE8 : 0xE0); // shr al, 1 / shl al, 1
+            emit_setcc_dl(e, CC_B);
+            emit_result_and_flag(e, x);
+            return;
+
+        case CHIP8_OP_ANNN:
+            emit_store16_imm(e, OFF_I, EXTRACT_NNN(opcode));
+            return;
+
+        case CHIP8_OP_FX1E:
+            emit_load16(e, REG_EAX, OFF_I);
+            emit_load8(e, REG_ECX, OFF_V(x));
+            emit8(e, 0x01); // add eax, ecx
+            emit8(e, 0xC8);
+            emit_store16(e, REG_EAX, OFF_I);
+            return;
+
+        case CHIP8_OP_FX07:
+            emit_load8(e, REG_EAX, OFF_DELAY);
+            emit_store8(e, REG_EAX, OFF_V(x));
+            return;
+
+        case CHIP8_OP_FX15:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_store8(e, REG_EAX, OFF_DELAY);
+            return;
+
+        case CHIP8_OP_FX18:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit_store8(e, REG_EAX, OFF_SOUND);
+            return;
+
+        // I = 0x050 + vx * 5
+        case CHIP8_OP_FX29:
+            emit_load8(e, REG_EAX, OFF_V(x));
+            emit8(e, 0x8D); // lea eax, [rax + rax * 4 + 0x50]
+            emit8(e, 0x44);
+            emit8(e, 0x80);
+            emit8(e, 0x50);
+            emit_store16(e, REG_EAX, OFF_I);
+            return;
+
+        default:
+            return;
+    }
+}
+
+// jcc rel32 or jmp rel32 to target, the offset is relative to the end of the jump
+static void emit_jcc(Emitter* e, uint8_t cc, uint8_t* target) {
+    emit8(e, 0x0F);
+    emit8(e, 0x80 | cc);
+    emit32(e, (uint32_t)(target - (e->p + 4)));
+}
+
+static uint8_t* emit_jmp_placeholder(Emitter* e) {
+    emit8(e, 0xE9);
+    uint8_t* rel = e->p;
+    emit32(e, 0);
+    return rel;
+}
+
+static void patch_rel32(uint8_t* rel, uint8_t* target) {
+    uint32_t offset = (uint32_t)(target - (rel + 4));
+    memcpy(rel, &offset, 4);
+}
+
+// compare for a skip, leaves flags so that cc is true when the skip is taken
+static uint8_t emit_skip_compare(Emitter* e, Chip8Op op, uint16_t opcode) {
+    int x = EXTRACT_X(opcode);
+    int y = EXTRACT_Y(opcode);
+
+    switch (op) {
+        case CHIP8_OP_3XNN:
+        case CHIP8_OP_4XNN:
+            emit_cmp8_imm(e, OFF_V(x), EXTRACT_NN(opcode));
+            return op == CHIP8_OP_3XNN ? CC_E : CC_NE;
+
+        case CHIP8_OP_5XY0:
+        case CHIP8_OP_9XY0:
+            emit_load8(e, REG_ECX, OFF_V(y));
+            emit_cmp8(e, OFF_V(x), REG_ECX);
+            return op == CHIP8_OP_5XY0 ? CC_E : CC_NE;
+
+        // key bit vx & 0xF goes into the carry, keys can't change inside a block
+        default:
+            emit_load8(e, REG_ECX, OFF_V(x));
+            emit8(e, 0x83); // and ecx, 0xF
+            emit8(e, 0xE1);
+            emit8(e, 0x0F);
+            emit_load16(e, REG_EAX, OFF_KEYS);
+            emit8(e, 0x0F); // bt eax, ecx
+            emit8(e, 0xA3);
+            emit8(e, 0xC8);
+            return op == CHIP8_OP_EX9E ? CC_B : CC_AE;
+    }
+}
+
+static int is_skip(Chip8Op op) {
+    return op == CHIP8_OP_3XNN || op == CHIP8_OP_4XNN || op == CHIP8_OP_5XY0 || op == CHIP8_OP_9XY0 ||
+        op == CHIP8_OP_EX9E || op == CHIP8_OP_EXA1;
+}
+
+// jumps, calls and returns always leave the block
+static int is_exit(Chip8Op op) {
+    return op == CHIP8_OP_1NNN || op == CHIP8_OP_2NNN || op == CHIP8_OP_00EE;
+}
+
+// return from the block: eax = instructions executed = r8d - esi
+static void emit_return(Emitter* e) {
+    emit8(e, 0x44); // mov eax, r8d
+    emit8(e, 0x89);
+    emit8(e, 0xC0);
+    emit8(e, 0x29); // sub eax, esi
+    emit8(e, 0xF0);
+    emit_ret(e);
+}
+
+// sub esi, count
+static void emit_charge(Emitter* e, int count) {
+    emit8(e, 0x81);
+    emit8(e, 0xEE);
+    emit32(e, count);
+}
+
+// how each instruction of a block is translated
+typedef enum JitKind {
+    JIT_SIMPLE,      // straight line, falls through
+    JIT_EXIT,        // 1NNN, 2NNN or 00EE, leaves the block
+    JIT_SKIP_INLINE, // skip whose next instruction is in the block, taken skips jump over it
+    JIT_SKIP_END,    // skip that ends the block, pc picked with a cmov
+} JitKind;
+
+typedef struct JitInst {
+    uint16_t opcode;
+    Chip8Op op;
+    JitKind kind;
+} JitInst;
+
+// a block is a superblock: skips over a translatable instruction stay inside it,
+// so the common "skip; jump" pairs become a conditional exit
+// every exit charges the budget for the instructions up to it, and a taken skip
+// refunds the one it skipped, so the count is exact on every path
+static int jit_scan(Chip8* chip8, uint16_t start, JitInst* insts, int* ended) {
+    uint16_t addr = start;
+    int n = 0;
+    *ended = 0;
+
+    while (n < JIT_MAX_BLOCK && addr <= 0xFFE) {
+        JitInst inst;
+        inst.opcode = chip8->memory[addr] << 8 | chip8->memory[addr + 1];
+        inst.op = chip8_decode_op(inst.opcode);
+
+        if (jit_simple(inst.op)) {
+            inst.kind = JIT_SIMPLE;
+        }
+        else if (is_exit(inst.op)) {
+            inst.kind = JIT_EXIT;
+        }
+        else if (is_skip(inst.op)) {
+            // the skipped instruction has to be straight line or an exit to stay inline
+            inst.kind = JIT_SKIP_END;
+            if (n + 1 < JIT_MAX_BLOCK && addr + 2 <= 0xFFE) {
+                uint16_t next = chip8->memory[addr + 2] << 8 | chip8->memory[addr + 3];
+                Chip8Op next_op = chip8_decode_op(next);
+                if (jit_simple(next_op) || is_exit(next_op)) {
+                    inst.kind = JIT_SKIP_INLINE;
+                }
+            }
+        }
+        else {
+            break;
+        }
+
+        insts[n++] = inst;
+        addr += 2;
+
+        // an exit only falls through when a skip can jump over it
+        if (inst.kind == JIT_SKIP_END ||
+            (inst.kind == JIT_EXIT && !(n >= 2 && insts[n - 2].kind == JIT_SKIP_INLINE))) {
+            *ended = 1;
+            break;
+        }
+    }
+
+    return n;
+}
+
+// leave the block for a known pc after charging count instructions
+// jumps straight back to the top instead when the target is the block itself
+// and there is still budget for a whole pass
+static void emit_exit(Emitter* e, uint16_t target, int count, uint16_t start, uint8_t* top, int n) {
+    emit_charge(e, count);
+    if (target == start) {
+        emit8(e, 0x81); // cmp esi, n
+        emit8(e, 0xFE);
+        emit32(e, n);
+        emit_jcc(e, 0xD, top); // jge top
+    }
+    emit_store16_imm(e, OFF_PC, target);
+    emit_return(e);
+}
+
+// drop every translated block
+static void jit_flush(Chip8Jit* jit) {
+    jit->code_used = 0;
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->block_len, 0, sizeof(jit->block_len));
+    memset(jit->tried, 0, sizeof(jit->tried));
+    memset(jit->covered, 0, sizeof(jit->covered));
+}
+
+// emit a jump, call or return
+static void emit_exit_op(Emitter* e, JitInst* inst, uint16_t addr, int count, uint16_t start, uint8_t* top, int n) {
+    switch (inst->op) {
+        // stack[top++ & 0xF] = addr + 2, then jump
+        case CHIP8_OP_2NNN:
+            emit_load8(e, REG_EAX, OFF_TOP);
+            emit8(e, 0x83); // and eax, 0xF
+            emit8(e, 0xE0);
+            emit8(e, 0x0F);
+            emit8(e, 0x66); // mov word [rdi + rax * 2 + stack], imm16
+            emit8(e, 0xC7);
+            emit8(e, 0x84);
+            emit8(e, 0x47);
+            emit32(e, (uint32_t)OFF_STACK);
+            emit16(e, addr + 2);
+            emit8(e, 0xFE); // inc byte [top]
+            emit_mem(e, 0, OFF_TOP);
+            emit_exit(e, EXTRACT_NNN(inst->opcode), count, start, top, n);
+            return;
+
+        // pc = stack[--top & 0xF]
+        case CHIP8_OP_00EE:
+            emit8(e, 0xFE); // dec byte [top]
+            emit_mem(e, 1, OFF_TOP);
+            emit_load8(e, REG_EAX, OFF_TOP);
+            emit8(e, 0x83); // and eax, 0xF
+            emit8(e, 0xE0);
+            emit8(e, 0x0F);
+            emit8(e, 0x0F); // movzx eax, word [rdi + rax * 2 + stack]
+            emit8(e, 0xB7);
+            emit8(e, 0x84);
+            emit8(e, 0x47);
+            emit32(e, (uint32_t)OFF_STACK);
+            emit_charge(e, count);
+            emit_store16(e, REG_EAX, OFF_PC);
+            emit_return(e);
+            return;
+
+        default:
+            emit_exit(e, EXTRACT_NNN(inst->opcode), count, start, top, n);
+            return;
+    }
+}
+
+// switch the code memory between writing blocks and running them
+// hardened kernels refuse a mapping that is both at once
+static int jit_set_writable(Chip8Jit* jit, int writable) {
+    if (jit->writable == writable) {
+        return 0;
+    }
+#if CHIP8_JIT_ENABLED
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    if (mprotect(jit->code, JIT_CODE_SIZE, prot) != 0) {
+        return -1;
+    }
+#endif
+    jit->writable = writable;
+    return 0;
+}
+
+// translate the block starting at start, leaves blocks[start] NULL if
+// the first instruction can't be translated
+static void jit_translate(Chip8Jit* jit, Chip8* chip8, uint16_t start) {
+    if (JIT_CODE_SIZE - jit->code_used < JIT_MAX_BLOCK_BYTES) {
+        jit_flush(jit);
+    }
+    jit->tried[start] = 1;
+
+    JitInst insts[JIT_MAX_BLOCK];
+    int ended;
+    int n = jit_scan(chip8, start, insts, &ended);
+    if (n == 0 || jit_set_writable(jit, 1) != 0) {
+        return;
+    }
+
+    Emitter e = { jit->code + jit->code_used };
+    uint8_t* begin = e.p;
+
+    // taken skips jump to the start of the instruction after next
+    uint8_t* skip_rel[JIT_MAX_BLOCK + 2] = { NULL };
+
+    emit8(&e, 0x41); // mov r8d, esi
+    emit8(&e, 0x89);
+    emit8(&e, 0xF0);
+    uint8_t* top = e.p;
+
+    for (int k = 0; k < n; k++) {
+        uint16_t addr = start + k * 2;
+        JitInst* inst = &insts[k];
+
+        if (skip_rel[k]) {
+            patch_rel32(skip_rel[k], e.p);
+        }
+
+        switch (inst->kind) {
+            case JIT_SIMPLE:
+                emit_simple(&e, inst->op, inst->opcode);
+                break;
+
+            case JIT_EXIT:
+                emit_exit_op(&e, inst, addr, k + 1, start, top, n);
+                break;
+
+            case JIT_SKIP_INLINE: {
+                // not taken runs the next instruction
+                // taken refunds it (inc esi) and jumps over it
+                uint8_t cc = emit_skip_compare(&e, inst->op, inst->opcode);
+                emit8(&e, 0x70 | (cc ^ 1)); // jncc over the next 7 bytes
+                emit8(&e, 7);
+                emit8(&e, 0xFF); // inc esi
+                emit8(&e, 0xC6);
+                skip_rel[k + 2] = emit_jmp_placeholder(&e);
+                break;
+            }
+
+            case JIT_SKIP_END: {
+                // pc = taken ? addr + 4 : addr + 2
+                // mov doesn't touch the flags from the compare
+                uint8_t cc = emit_skip_compare(&e, inst->op, inst->opcode);
+                emit_mov_imm(&e, REG_EAX, (uint16_t)(addr + 2));
+                emit_mov_imm(&e, REG_EDX, (uint16_t)(addr + 4));
+                emit_cmov_eax_edx(&e, cc);
+                emit_charge(&e, k + 1);
+                emit_store16(&e, REG_EAX, OFF_PC);
+                emit_return(&e);
+                break;
+            }
+        }
+    }
+
+    // fell off the end into something the interpreter has to run, continue there
+    uint16_t end = start + n * 2;
+    if (skip_rel[n]) {
+        patch_rel32(skip_rel[n], e.p);
+    }
+    if (!ended || skip_rel[n]) {
+        emit_exit(&e, end, n, start, top, n);
+    }
+
+    jit->code_used += e.p - begin;
+    jit->blocks[start] = (Chip8Block)(void*)begin;
+    jit->block_len[start] = n;
+    memset(&jit->covered[start], 1, end - start);
+    jit->translated++;
+}
+
+Chip8Jit* chip8_jit_create(void) {
+    Chip8Jit* jit = calloc(1, sizeof(Chip8Jit));
+    if (jit == NULL) {
+        return NULL;
+    }
+
+#if CHIP8_JIT_ENABLED
+    // mapped read execute up front, so a kernel that won't allow executable
+    // memory at all is found now rather than at the first block
+    void* code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        // no executable memory, everything will be interpreted
+        fprintf(stderr, "failed to map jit code buffer, interpreting instead\n");
+        code = NULL;
+    }
+    jit->code = code;
+#endif
+
+    return jit;
+}
+
+void chip8_jit_destroy(Chip8Jit* jit) {
+    if (jit == NULL) {
+        return;
+    }
+#if CHIP8_JIT_ENABLED
+    if (jit->code) {
+        munmap(jit->code, JIT_CODE_SIZE);
+    }
+#endif
+    free(jit);
+}
+
+// flush if any written byte, or the opcode starting just before it, is translated
+void chip8_jit_invalidate(Chip8Jit* jit, uint16_t addr, int len) {
+    for (int i = -1; i < len; i++) {
+        if (jit->covered[(addr + i) & 0xFFF]) {
+            jit_flush(jit);
+            return;
+        }
+    }
+}
+
+uint64_t chip8_jit_blocks_translated(const Chip8Jit* jit) {
+    return jit->translated;
+}
+
+// run translated blocks where there are some, and chip8_step everywhere else
+// a block only runs if it fits in the remaining budget, so cycle counts are exact
+Chip8Status chip8_jit_run_cycles(Chip8Jit* jit, Chip8* chip8, int cycles, int* executed) {
+    if (jit->code == NULL) {
+        return chip8_run_cycles(chip8, cycles, executed);
+    }
+
+    Chip8Status status = CHIP8_BUDGET;
+    int i = chip8->fast_forward ? chip8_skip_idle(chip8, cycles) : 0;
+
+    while (i < cycles) {
+        uint16_t pc = chip8->pc;
+
+        if (pc <= 0xFFE) {
+            if (!jit->tried[pc]) {
+                jit_translate(jit, chip8, pc);
+            }
+            Chip8Block block = jit->blocks[pc];
+            if (block && jit->block_len[pc] <= cycles - i && jit_set_writable(jit, 0) == 0) {
+                i += block(chip8, cycles - i);
+                continue;
+            }
+        }
+
+        // interpret one instruction
+        // stores are never translated, so this is the only place code can change
+        uint16_t opcode = FETCH_OPCODE();
+        uint16_t store_addr = chip8->I;
+        Chip8Status s = chip8_step(chip8);
+
+        if ((opcode & 0xF0FF) == 0xF055) {
+            chip8_jit_invalidate(jit, store_addr, EXTRACT_X(opcode) + 1);
+        }
+        else if ((opcode & 0xF0FF) == 0xF033) {
+            chip8_jit_invalidate(jit, store_addr, 3);
+        }
+
+        if (s != CHIP8_OK) {
+            if (s == CHIP8_DRAW) {
+                i++;
+            }
+            status = s;
+            break;
+        }
+        i++;
+    }
+
+    if (executed) {
+        *executed = i;
+    }
+    return status;
+}
@@ -0,0 +1,30 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// basic block JIT for x86-64
+// straight line runs of register, timer and index instructions are translated into native code
+// the first time their start address runs; everything else (draws, keys, calls, stores, random)
+// goes through chip8_step, which stays the reference
+// on other hosts, or if executable memory can't be mapped, every instruction is interpreted
+
+typedef struct Chip8Jit Chip8Jit;
+
+// one jit per Chip8, the translated blocks are specific to its memory
+// returns NULL if it can't be allocated, a jit without executable memory still
+// works and interprets everything
+Chip8Jit* chip8_jit_create(void);
+void chip8_jit_destroy(Chip8Jit* jit);
+
+// run up to the given number of cycles, same contract as chip8_run_cycles
+Chip8Status chip8_jit_run_cycles(Chip8Jit* jit, Chip8* chip8, int cycles, int* executed);
+
+// drop translated blocks covering memory written outside the interpreter
+// (FX33 and FX55 are handled by chip8_jit_run_cycles itself)
+void chip8_jit_invalidate(Chip8Jit* jit, uint16_t addr, int len);
+
+// number of blocks translated since the jit was created, for benchmarking
+uint64_t chip8_jit_blocks_translated(const Chip8Jit* jit);
+
+#endif
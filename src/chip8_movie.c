@@ -0,0 +1,241 @@
+#include "./chip8_movie.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 1
+#define HEADER_SIZE 32
+
+// most a varint frame delta and a key mask can take
+#define MAX_EVENT_SIZE 7
+
+typedef struct Chip8MovieEvent {
+    uint32_t frame;
+    uint16_t keys;
+} Chip8MovieEvent;
+
+struct Chip8Movie {
+    int cycles_per_frame;
+    uint32_t rng;      // generator state at frame 0
+    uint64_t rom_hash; // of memory from 0x200 up at frame 0
+    uint32_t frames;
+
+    // key changes in frame order, the keys are 0 before the first
+    Chip8MovieEvent* events;
+    uint32_t count;
+    uint32_t capacity;
+
+    // playback position, the first event after the last frame asked for
+    uint32_t cursor;
+};
+
+static uint64_t rom_hash(const Chip8* chip8) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0x200; i < 4096; i++) {
+        hash ^= chip8->memory[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// little endian fields, so a movie plays on any host
+static void put_le(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint64_t get_le(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (i * 8);
+    }
+    return value;
+}
+
+Chip8Movie* chip8_movie_create(const Chip8* chip8, int cycles_per_frame) {
+    Chip8Movie* movie = calloc(1, sizeof(Chip8Movie));
+    if (movie == NULL) {
+        return NULL;
+    }
+    movie->cycles_per_frame = cycles_per_frame;
+    movie->rng = chip8->rng;
+    movie->rom_hash = rom_hash(chip8);
+    return movie;
+}
+
+void chip8_movie_destroy(Chip8Movie* movie) {
+    if (movie == NULL) {
+        return;
+    }
+    free(movie->events);
+    free(movie);
+}
+
+static int add_event(Chip8Movie* movie, uint32_t frame, uint16_t keys) {
+    if (movie->count == movie->capacity) {
+        uint32_t capacity = movie->capacity ? movie->capacity * 2 : 256;
+        Chip8MovieEvent* events = realloc(movie->events, capacity * sizeof(Chip8MovieEvent));
+        if (events == NULL) {
+            return -1;
+        }
+        movie->events = events;
+        movie->capacity = capacity;
+    }
+    movie->events[movie->count].frame = frame;
+    movie->events[movie->count].keys = keys;
+    movie->count++;
+    return 0;
+}
+
+int chip8_movie_record(Chip8Movie* movie, uint32_t frame, uint16_t keys) {
+    uint16_t held = movie->count ? movie->events[movie->count - 1].keys : 0;
+    if (frame + 1 > movie->frames) {
+        movie->frames = frame + 1;
+    }
+    if (keys == held) {
+        return 0;
+    }
+    return add_event(movie, frame, keys);
+}
+
+void chip8_movie_truncate(Chip8Movie* movie, uint32_t frame) {
+    while (movie->count > 0 && movie->events[movie->count - 1].frame >= frame) {
+        movie->count--;
+    }
+    if (movie->frames > frame) {
+        movie->frames = frame;
+    }
+    movie->cursor = 0;
+}
+
+void chip8_movie_set_frames(Chip8Movie* movie, uint32_t frames) {
+    movie->frames = frames;
+}
+
+int chip8_movie_save(const Chip8Movie* movie, const char* filename) {
+    size_t size = HEADER_SIZE + (size_t)movie->count * MAX_EVENT_SIZE;
+    uint8_t* data = malloc(size);
+    if (data == NULL) {
+        return -1;
+    }
+
+    memset(data, 0, HEADER_SIZE);
+    memcpy(data, MOVIE_MAGIC, 4);
+    put_le(data + 4, MOVIE_VERSION, 2);
+    put_le(data + 8, (uint32_t)movie->cycles_per_frame, 4);
+    put_le(data + 12, movie->rng, 4);
+    put_le(data + 16, movie->rom_hash, 8);
+    put_le(data + 24, movie->frames, 4);
+    put_le(data + 28, movie->count, 4);
+
+    size_t n = HEADER_SIZE;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < movie->count; i++) {
+        uint32_t delta = movie->events[i].frame - last;
+        last = movie->events[i].frame;
+        while (delta >= 0x80) {
+            data[n++] = (uint8_t)(delta | 0x80);
+            delta >>= 7;
+        }
+        data[n++] = (uint8_t)delta;
+        put_le(data + n, movie->events[i].keys, 2);
+        n += 2;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    int ok = file != NULL && fwrite(data, 1, n, file) == n;
+    if (file != NULL) {
+        ok &= fclose(file) == 0;
+    }
+    free(data);
+    return ok ? 0 : -1;
+}
+
+Chip8Movie* chip8_movie_load(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    uint8_t* data = size >= HEADER_SIZE ? malloc(size) : NULL;
+    int ok = data != NULL && fread(data, 1, size, file) == (size_t)size;
+    fclose(file);
+    ok = ok && memcmp(data, MOVIE_MAGIC, 4) == 0 && get_le(data + 4, 2) == MOVIE_VERSION;
+
+    Chip8Movie* movie = ok ? calloc(1, sizeof(Chip8Movie)) : NULL;
+    if (movie == NULL) {
+        free(data);
+        return NULL;
+    }
+    movie->cycles_per_frame = (int)get_le(data + 8, 4);
+    movie->rng = (uint32_t)get_le(data + 12, 4);
+    movie->rom_hash = get_le(data + 16, 8);
+    movie->frames = (uint32_t)get_le(data + 24, 4);
+    uint32_t count = (uint32_t)get_le(data + 28, 4);
+
+    long n = HEADER_SIZE;
+    uint32_t frame = 0;
+    for (uint32_t i = 0; i < count && ok; i++) {
+        uint32_t delta = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            if (n >= size || shift > 28) {
+                ok = 0;
+                break;
+            }
+            byte = data[n++];
+            delta |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        if (!ok || n + 2 > size) {
+            ok = 0;
+            break;
+        }
+        frame += delta;
+        ok = add_event(movie, frame, (uint16_t)get_le(data + n, 2)) == 0;
+        n += 2;
+    }
+    free(data);
+
+    if (!ok || movie->cycles_per_frame <= 0) {
+        chip8_movie_destroy(movie);
+        return NULL;
+    }
+    return movie;
+}
+
+int chip8_movie_start(const Chip8Movie* movie, Chip8* chip8) {
+    if (rom_hash(chip8) != movie->rom_hash) {
+        return -1;
+    }
+    chip8->rng = movie->rng;
+    chip8->keys = 0;
+    return 0;
+}
+
+uint16_t chip8_movie_keys(Chip8Movie* movie, uint32_t frame) {
+    // going backwards starts the search over
+    if (movie->cursor > 0 && movie->events[movie->cursor - 1].frame > frame) {
+        movie->cursor = 0;
+    }
+    while (movie->cursor < movie->count && movie->events[movie->cursor].frame <= frame) {
+        movie->cursor++;
+    }
+    return movie->cursor ? movie->events[movie->cursor - 1].keys : 0;
+}
+
+uint32_t chip8_movie_frames(const Chip8Movie* movie) {
+    return movie->frames;
+}
+
+int chip8_movie_cycles_per_frame(const Chip8Movie* movie) {
+    return movie->cycles_per_frame;
+}
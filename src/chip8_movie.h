@@ -0,0 +1,45 @@
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// input movies
+// records the keypad as it stood at the start of each frame, storing only the
+// frames where it changed, so a run can be played back bit for bit later, headless
+// and uncapped, as long as the same ROM, generator state and frame length are used
+// the file is a fixed little endian header followed by (frames since the last
+// event as a LEB128 varint, 16 bit key mask) events
+
+typedef struct Chip8Movie Chip8Movie;
+
+// start a recording of a machine that has its ROM loaded and hasn't run yet
+// the ROM and the generator state are remembered so playback can check and restore them
+Chip8Movie* chip8_movie_create(const Chip8* chip8, int cycles_per_frame);
+void chip8_movie_destroy(Chip8Movie* movie);
+
+// the keys held at the start of frame, frames are recorded in order
+// returns -1 if the event list couldn't grow, 0 otherwise
+int chip8_movie_record(Chip8Movie* movie, uint32_t frame, uint16_t keys);
+
+// forget frame and everything after it, for when the player rewinds
+void chip8_movie_truncate(Chip8Movie* movie, uint32_t frame);
+
+// the recording is frames long, set before saving
+void chip8_movie_set_frames(Chip8Movie* movie, uint32_t frames);
+
+// returns 0 on success, -1 on failure
+int chip8_movie_save(const Chip8Movie* movie, const char* filename);
+// NULL if the file can't be read or isn't a movie
+Chip8Movie* chip8_movie_load(const char* filename);
+
+// get a freshly loaded machine ready to play the movie back
+// returns -1 if the machine holds a different ROM than the one recorded
+int chip8_movie_start(const Chip8Movie* movie, Chip8* chip8);
+
+// keys held at the start of frame, fastest when called for each frame in order
+uint16_t chip8_movie_keys(Chip8Movie* movie, uint32_t frame);
+
+uint32_t chip8_movie_frames(const Chip8Movie* movie);
+int chip8_movie_cycles_per_frame(const Chip8Movie* movie);
+
+#endif
@@ -0,0 +1,497 @@
+#ifndef CHIP8_OPS_H
+#define CHIP8_OPS_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./chip8.h"
+
+// instruction handlers shared by every dispatch mode
+// each handler runs after the fetch, so pc already points at the next instruction
+// they are static inline so the switch can inline them and the table can point at them
+
+// these allow us to grab the instructions from each fetch
+// can pull out each nibble from opcode
+// addresses wrap at 4kb so a runaway pc never reads past memory
+#define FETCH_OPCODE() (chip8->memory[chip8->pc & 0xFFF] << 8 | chip8->memory[(chip8->pc + 1) & 0xFFF])
+#define EXTRACT_X(opcode) ((opcode & 0x0F00) >> 8)
+#define EXTRACT_Y(opcode) ((opcode & 0x00F0) >> 4)
+#define EXTRACT_N(opcode) (opcode & 0x000F)
+#define EXTRACT_NN(opcode) (opcode & 0x00FF)
+#define EXTRACT_NNN(opcode) (opcode & 0x0FFF)
+
+// list of every handler, X(name, function)
+// used to build the handler enum, the dispatch table and the name table
+#define CHIP8_OPS(X) \
+    X(INVALID, op_invalid) \
+    X(00E0, op_00e0) \
+    X(00EE, op_00ee) \
+    X(1NNN, op_1nnn) \
+    X(2NNN, op_2nnn) \
+    X(3XNN, op_3xnn) \
+    X(4XNN, op_4xnn) \
+    X(5XY0, op_5xy0) \
+    X(6XNN, op_6xnn) \
+    X(7XNN, op_7xnn) \
+    X(8XY0, op_8xy0) \
+    X(8XY1, op_8xy1) \
+    X(8XY2, op_8xy2) \
+    X(8XY3, op_8xy3) \
+    X(8XY4, op_8xy4) \
+    X(8XY5, op_8xy5) \
+    X(8XY6, op_8xy6) \
+    X(8XY7, op_8xy7) \
+    X(8XYE, op_8xye) \
+    X(9XY0, op_9xy0) \
+    X(ANNN, op_annn) \
+    X(BNNN, op_bnnn) \
+    X(CXNN, op_cxnn) \
+    X(DXYN, op_dxyn) \
+    X(EX9E, op_ex9e) \
+    X(EXA1, op_exa1) \
+    X(FX07, op_fx07) \
+    X(FX0A, op_fx0a) \
+    X(FX15, op_fx15) \
+    X(FX18, op_fx18) \
+    X(FX1E, op_fx1e) \
+    X(FX29, op_fx29) \
+    X(FX33, op_fx33) \
+    X(FX55, op_fx55) \
+    X(FX65, op_fx65)
+
+// handler index, CHIP8_OP_00E0 and so on
+#define CHIP8_OP_ENUM(name, fn) CHIP8_OP_##name,
+typedef enum Chip8Op {
+    CHIP8_OPS(CHIP8_OP_ENUM)
+    CHIP8_OP_COUNT
+} Chip8Op;
+#undef CHIP8_OP_ENUM
+
+// decode an opcode into its handler index
+// this is the nested switch from the interpreter with the bodies pulled out
+static inline Chip8Op chip8_decode_op(uint16_t opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (opcode & 0x00FF) {
+                case 0x00E0: return CHIP8_OP_00E0;
+                case 0x00EE: return CHIP8_OP_00EE;
+            }
+            break;
+        case 0x1000: return CHIP8_OP_1NNN;
+        case 0x2000: return CHIP8_OP_2NNN;
+        case 0x3000: return CHIP8_OP_3XNN;
+        case 0x4000: return CHIP8_OP_4XNN;
+        case 0x5000: return CHIP8_OP_5XY0;
+        case 0x6000: return CHIP8_OP_6XNN;
+        case 0x7000: return CHIP8_OP_7XNN;
+        case 0x8000:
+            switch (EXTRACT_N(opcode)) {
+                case 0x0000: return CHIP8_OP_8XY0;
+                case 0x0001: return CHIP8_OP_8XY1;
+                case 0x0002: return CHIP8_OP_8XY2;
+                case 0x0003: return CHIP8_OP_8XY3;
+                case 0x0004: return CHIP8_OP_8XY4;
+                case 0x0005: return CHIP8_OP_8XY5;
+                case 0x0006: return CHIP8_OP_8XY6;
+                case 0x0007: return CHIP8_OP_8XY7;
+                case 0x000E: return CHIP8_OP_8XYE;
+            }
+            break;
+        case 0x9000: return CHIP8_OP_9XY0;
+        case 0xA000: return CHIP8_OP_ANNN;
+        case 0xB000: return CHIP8_OP_BNNN;
+        case 0xC000: return CHIP8_OP_CXNN;
+        case 0xD000: return CHIP8_OP_DXYN;
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x009E: return CHIP8_OP_EX9E;
+                case 0x00A1: return CHIP8_OP_EXA1;
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0007: return CHIP8_OP_FX07;
+                case 0x000A: return CHIP8_OP_FX0A;
+                case 0x0015: return CHIP8_OP_FX15;
+                case 0x0018: return CHIP8_OP_FX18;
+                case 0x001E: return CHIP8_OP_FX1E;
+                case 0x0029: return CHIP8_OP_FX29;
+                case 0x0033: return CHIP8_OP_FX33;
+                case 0x0055: return CHIP8_OP_FX55;
+                case 0x0065: return CHIP8_OP_FX65;
+            }
+            break;
+    }
+    return CHIP8_OP_INVALID;
+}
+
+// unknown opcodes do nothing
+static inline Chip8Status op_invalid(Chip8* chip8, uint16_t opcode) {
+    (void)chip8;
+    (void)opcode;
+    return CHIP8_OK;
+}
+
+// clear
+static inline Chip8Status op_00e0(Chip8* chip8, uint16_t opcode) {
+    (void)opcode;
+    // clears the display by setting every packed row to 0
+    // only rows that had something on them change
+    for (int y = 0; y < 32; y++) {
+        chip8->dirty_rows |= (uint32_t)(chip8->display[y] != 0) << y;
+    }
+    // sets the 256 bytes of the display memory block to zero
+    memset(chip8->display, 0x0, sizeof(chip8->display));
+    return CHIP8_OK;
+}
+
+// return from subroutine
+static inline Chip8Status op_00ee(Chip8* chip8, uint16_t opcode) {
+    (void)opcode;
+    // pop the last address from stack and set pc to it
+    chip8->pc = chip8_pop(chip8);
+    return CHIP8_OK;
+}
+
+// jump
+static inline Chip8Status op_1nnn(Chip8* chip8, uint16_t opcode) {
+    // sets the program counter to the address given by NNN
+    chip8->pc = EXTRACT_NNN(opcode);
+    return CHIP8_OK;
+}
+
+// subroutine
+static inline Chip8Status op_2nnn(Chip8* chip8, uint16_t opcode) {
+    // calls subroutine at memory location NNN
+    // first, pushes the current PC to the stack
+    chip8_push(chip8, chip8->pc);
+    chip8->pc = EXTRACT_NNN(opcode);
+    return CHIP8_OK;
+}
+
+// skip one instruction if VX == NN
+static inline Chip8Status op_3xnn(Chip8* chip8, uint16_t opcode) {
+    if (chip8->V[EXTRACT_X(opcode)] == EXTRACT_NN(opcode)) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// skip one instruction if VX != NN
+static inline Chip8Status op_4xnn(Chip8* chip8, uint16_t opcode) {
+    if (chip8->V[EXTRACT_X(opcode)] != EXTRACT_NN(opcode)) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// skip one instruction if VX == VY
+static inline Chip8Status op_5xy0(Chip8* chip8, uint16_t opcode) {
+    if (chip8->V[EXTRACT_X(opcode)] == chip8->V[EXTRACT_Y(opcode)]) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// set vx
+static inline Chip8Status op_6xnn(Chip8* chip8, uint16_t opcode) {
+    // sets the register vx to the value nn
+    chip8->V[EXTRACT_X(opcode)] = EXTRACT_NN(opcode);
+    return CHIP8_OK;
+}
+
+// add to vx
+static inline Chip8Status op_7xnn(Chip8* chip8, uint16_t opcode) {
+    // adds nn to register vx
+    chip8->V[EXTRACT_X(opcode)] += EXTRACT_NN(opcode);
+    return CHIP8_OK;
+}
+
+// set VX to VY
+static inline Chip8Status op_8xy0(Chip8* chip8, uint16_t opcode) {
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_Y(opcode)];
+    return CHIP8_OK;
+}
+
+// ON ORIGINAL CHIP-8, OR, AND, XOR SET VF TO 0
+// binary or
+static inline Chip8Status op_8xy1(Chip8* chip8, uint16_t opcode) {
+    // vx is set to vx | vy
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_X(opcode)] | chip8->V[EXTRACT_Y(opcode)];
+    chip8->V[0xF] = 0;
+    return CHIP8_OK;
+}
+
+// binary and
+static inline Chip8Status op_8xy2(Chip8* chip8, uint16_t opcode) {
+    // vx is set to vx & vy
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_X(opcode)] & chip8->V[EXTRACT_Y(opcode)];
+    chip8->V[0xF] = 0;
+    return CHIP8_OK;
+}
+
+// logical xor
+static inline Chip8Status op_8xy3(Chip8* chip8, uint16_t opcode) {
+    // vx is set to vx ^ vy
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_X(opcode)] ^ chip8->V[EXTRACT_Y(opcode)];
+    chip8->V[0xF] = 0;
+    return CHIP8_OK;
+}
+
+// add
+static inline Chip8Status op_8xy4(Chip8* chip8, uint16_t opcode) {
+    // if vy + vx is > 255, then vf set to 1
+    int carry = chip8->V[EXTRACT_X(opcode)] + chip8->V[EXTRACT_Y(opcode)] > 255;
+
+    // add vy to vx
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_X(opcode)] + chip8->V[EXTRACT_Y(opcode)];
+    chip8->V[0xF] = carry;
+    return CHIP8_OK;
+}
+
+// subtract
+static inline Chip8Status op_8xy5(Chip8* chip8, uint16_t opcode) {
+    // if vx is larger than vy, then vf is set to 1, else vf is set to 0
+    int no_borrow = chip8->V[EXTRACT_X(opcode)] >= chip8->V[EXTRACT_Y(opcode)];
+
+    // vx is set to vx-vy
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_X(opcode)] - chip8->V[EXTRACT_Y(opcode)];
+    chip8->V[0xF] = no_borrow;
+    return CHIP8_OK;
+}
+
+// subtract
+static inline Chip8Status op_8xy7(Chip8* chip8, uint16_t opcode) {
+    // if vy is larger than vx, then vf is set to 1, else vf is set to 0
+    int no_borrow = chip8->V[EXTRACT_Y(opcode)] >= chip8->V[EXTRACT_X(opcode)];
+
+    // vx is set to vy-vx
+    chip8->V[EXTRACT_X(opcode)] = chip8->V[EXTRACT_Y(opcode)] - chip8->V[EXTRACT_X(opcode)];
+    chip8->V[0xF] = no_borrow;
+    return CHIP8_OK;
+}
+
+// shift right
+// vx is shifted in place, vy is ignored
+static inline Chip8Status op_8xy6(Chip8* chip8, uint16_t opcode) {
+    // set VF to the least significant bit of VX
+    int carry = chip8->V[EXTRACT_X(opcode)] & 0x01;
+    // shift VX to the right by 1 bit
+    chip8->V[EXTRACT_X(opcode)] >>= 1;
+
+    chip8->V[0xF] = carry;
+    return CHIP8_OK;
+}
+
+// shift left
+static inline Chip8Status op_8xye(Chip8* chip8, uint16_t opcode) {
+    // set VF to the most significant bit of VX
+    int carry = (chip8->V[EXTRACT_X(opcode)] & 0x80) >> 7;
+    // shift VX to the left by 1 bit
+    chip8->V[EXTRACT_X(opcode)] <<= 1;
+
+    chip8->V[0xF] = carry;
+    return CHIP8_OK;
+}
+
+// skip one instruction if VX != VY
+static inline Chip8Status op_9xy0(Chip8* chip8, uint16_t opcode) {
+    if (chip8->V[EXTRACT_X(opcode)] != chip8->V[EXTRACT_Y(opcode)]) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// set I
+static inline Chip8Status op_annn(Chip8* chip8, uint16_t opcode) {
+    // set index register I to NNN
+    chip8->I = EXTRACT_NNN(opcode);
+    return CHIP8_OK;
+}
+
+// jump with offset
+static inline Chip8Status op_bnnn(Chip8* chip8, uint16_t opcode) {
+    chip8->pc = chip8->V[0] + EXTRACT_NNN(opcode);
+    return CHIP8_OK;
+}
+
+// next random byte from a generator state
+// xorshift32 steps the state, the multiply mixes the high bits into the top byte
+static inline uint8_t chip8_random_next(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (uint8_t)((x * 0x9E3779B1u) >> 24);
+}
+
+// random number
+static inline Chip8Status op_cxnn(Chip8* chip8, uint16_t opcode) {
+    // generate a random byte from this machine's generator and binary and with NN
+    // store value into vx
+    chip8->V[EXTRACT_X(opcode)] = chip8_random_next(&chip8->rng) & EXTRACT_NN(opcode);
+    return CHIP8_OK;
+}
+
+// draw
+static inline Chip8Status op_dxyn(Chip8* chip8, uint16_t opcode) {
+    // draw sprite at coordinate (VX, VY) with N bytes of sprite data starting at the address stored in I
+
+    // extract x, y, and n
+    // modulo by 64 and 32 so the starting position can wrap
+    uint8_t x = chip8->V[EXTRACT_X(opcode)] % 64;
+    uint8_t y = chip8->V[EXTRACT_Y(opcode)] % 32;
+    uint8_t n = EXTRACT_N(opcode);
+
+    // reaching the bottom of the screen will stop, rows past 31 are clipped
+    if (n > 32 - y) {
+        n = 32 - y;
+    }
+
+    // collision bits from every row, VF is set if any are on
+    uint64_t collision = 0;
+
+    for (int row = 0; row < n; row++) {
+        // get the nth byte of sprite data from memory (starts at I)
+        uint8_t sprite_byte = chip8->memory[(chip8->I + row) & 0xFFF];
+
+        // move the sprite byte to the top of the row then over to column x
+        // pixels pushed past column 63 fall off the end, which clips the right edge
+        uint64_t sprite = ((uint64_t)sprite_byte << 56) >> x;
+
+        // pixels that are on in both will turn off, that's a collision
+        collision |= chip8->display[y + row] & sprite;
+        chip8->display[y + row] ^= sprite;
+        // xor with any set bit changes the row, a blank sprite row leaves it alone
+        chip8->dirty_rows |= (uint32_t)(sprite != 0) << (y + row);
+    }
+
+    chip8->V[0xF] = collision != 0;
+
+    // display wait quirk, the caller should stop until the next frame
+    return CHIP8_DRAW;
+}
+
+// skip an instruction if the key corresponding to the value in vx is pressed
+static inline Chip8Status op_ex9e(Chip8* chip8, uint16_t opcode) {
+    if (chip8->keys & (1 << (chip8->V[EXTRACT_X(opcode)] & 0xF))) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// skip an instruction if the key corresponding to the value in vx is not pressed
+static inline Chip8Status op_exa1(Chip8* chip8, uint16_t opcode) {
+    if (!(chip8->keys & (1 << (chip8->V[EXTRACT_X(opcode)] & 0xF)))) {
+        chip8->pc += 2;
+    }
+    return CHIP8_OK;
+}
+
+// sets vx to the current value of the delay timer
+static inline Chip8Status op_fx07(Chip8* chip8, uint16_t opcode) {
+    chip8->V[EXTRACT_X(opcode)] = chip8->delay_timer;
+    return CHIP8_OK;
+}
+
+// get key
+static inline Chip8Status op_fx0a(Chip8* chip8, uint16_t opcode) {
+    // once a key has gone down and come back up, put its hexadecimal value into vx
+    // and continue, until then stay on this instruction and let the caller
+    // carry on with its frame (timers keep running there)
+    // the progress is kept in the machine, so every call is one check
+    if (chip8->key_wait == CHIP8_KEY_WAIT_RELEASE) {
+        if (!(chip8->keys & (1 << chip8->key_wait_key))) {
+            chip8->V[EXTRACT_X(opcode)] = chip8->key_wait_key;
+            chip8->key_wait = CHIP8_KEY_WAIT_NONE;
+            return CHIP8_OK;
+        }
+    }
+    else {
+        chip8->key_wait = CHIP8_KEY_WAIT_PRESS;
+        for (int i = 0; i < 16; i++) {
+            if (chip8->keys & (1 << i)) {
+                chip8->key_wait_key = i;
+                chip8->key_wait = CHIP8_KEY_WAIT_RELEASE;
+                break;
+            }
+        }
+    }
+    chip8->pc -= 2;
+    return CHIP8_KEY_WAIT;
+}
+
+// sets delay timer to vx
+static inline Chip8Status op_fx15(Chip8* chip8, uint16_t opcode) {
+    chip8->delay_timer = chip8->V[EXTRACT_X(opcode)];
+    return CHIP8_OK;
+}
+
+// sets sound timer to vx
+static inline Chip8Status op_fx18(Chip8* chip8, uint16_t opcode) {
+    chip8->sound_timer = chip8->V[EXTRACT_X(opcode)];
+    return CHIP8_OK;
+}
+
+// add vx to register I
+static inline Chip8Status op_fx1e(Chip8* chip8, uint16_t opcode) {
+    chip8->I += chip8->V[EXTRACT_X(opcode)];
+    return CHIP8_OK;
+}
+
+// font
+static inline Chip8Status op_fx29(Chip8* chip8, uint16_t opcode) {
+    // index register I is set to address of hexadecimal character stored in vx
+    // point I to the right font memory address
+    chip8->I = 0x050 + (chip8->V[EXTRACT_X(opcode)] * 5);
+    return CHIP8_OK;
+}
+
+// binary coded decimal conversion
+static inline Chip8Status op_fx33(Chip8* chip8, uint16_t opcode) {
+    // take number in vx and convert to three digit decimal
+    // store at memory address I, I+1, I+2
+    uint8_t value = chip8->V[EXTRACT_X(opcode)];
+    chip8->memory[(chip8->I + 2) & 0xFFF] = value % 10;
+    value /= 10;
+    chip8->memory[(chip8->I + 1) & 0xFFF] = value % 10;
+    value /= 10;
+    chip8->memory[chip8->I & 0xFFF] = value % 10;
+
+    // the digits may have landed on predecoded code
+    if (chip8->decoded) {
+        chip8_invalidate_code(chip8, chip8->I, 3);
+    }
+    return CHIP8_OK;
+}
+
+// store and load memory
+
+// OLD BEHAVIOR INCREMENTS I
+// will not implement here for sake of testing roms
+static inline Chip8Status op_fx55(Chip8* chip8, uint16_t opcode) {
+    // from registers v0 to vx (get x)
+    // the values of them will be stored in
+    // I, I+1, I+X
+    for (int i = 0; i <= EXTRACT_X(opcode); i++) {
+        chip8->memory[(chip8->I + i) & 0xFFF] = chip8->V[i];
+    }
+
+    // self modifying code, drop any predecoded instructions that were overwritten
+    if (chip8->decoded) {
+        chip8_invalidate_code(chip8, chip8->I, EXTRACT_X(opcode) + 1);
+    }
+    return CHIP8_OK;
+}
+
+static inline Chip8Status op_fx65(Chip8* chip8, uint16_t opcode) {
+    // from memory address I, store the
+    // values in those addresses into
+    // registers v0 to vx
+    for (int i = 0; i <= EXTRACT_X(opcode); i++) {
+        chip8->V[i] = chip8->memory[(chip8->I + i) & 0xFFF];
+    }
+    return CHIP8_OK;
+}
+
+#endif
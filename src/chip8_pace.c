@@ -0,0 +1,95 @@
+#include "./chip8_pace.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NS_PER_SECOND 1000000000LL
+
+// upper bounds of every bucket but the last, in nanoseconds
+static const int64_t bucket_limits[CHIP8_PACE_BUCKETS - 1] = {
+    10000, 20000, 50000, 100000, 200000, 500000,
+    1000000, 2000000, 5000000, 10000000, 20000000,
+};
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SECOND + ts.tv_nsec;
+}
+
+void chip8_pace_init(Chip8Pace* pace, int hz, int64_t spin_ns) {
+    pace->epoch = now_ns();
+    pace->frame = 0;
+    pace->hz = hz;
+    pace->spin_ns = spin_ns;
+    for (int b = 0; b < CHIP8_PACE_BUCKETS; b++) {
+        pace->histogram[b] = 0;
+    }
+    pace->waits = 0;
+    pace->worst_ns = 0;
+    pace->resyncs = 0;
+}
+
+static int64_t deadline(const Chip8Pace* pace) {
+    return pace->epoch + (int64_t)(pace->frame * NS_PER_SECOND / pace->hz);
+}
+
+void chip8_pace_wait(Chip8Pace* pace) {
+    int64_t target = deadline(pace);
+    int64_t now = now_ns();
+
+    if (now - target > CHIP8_PACE_MAX_BEHIND * NS_PER_SECOND / pace->hz) {
+        // stalled, e.g. suspended or dragged, start again from here
+        pace->epoch = now;
+        pace->frame = 0;
+        pace->resyncs++;
+        target = now;
+    }
+
+    if (target - now > pace->spin_ns) {
+        int64_t wake = target - pace->spin_ns;
+        struct timespec ts;
+        ts.tv_sec = wake / NS_PER_SECOND;
+        ts.tv_nsec = wake % NS_PER_SECOND;
+        // an absolute deadline, so a signal just means sleeping again for the rest,
+        // any other error gives up on sleeping and the spin below waits it out
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+    do {
+        now = now_ns();
+    } while (now < target);
+
+    int64_t error = now - target;
+    int b = 0;
+    while (b < CHIP8_PACE_BUCKETS - 1 && error > bucket_limits[b]) {
+        b++;
+    }
+    pace->histogram[b]++;
+    pace->waits++;
+    if (error > pace->worst_ns) {
+        pace->worst_ns = error;
+    }
+    pace->frame++;
+}
+
+void chip8_pace_print(const Chip8Pace* pace, FILE* out) {
+    if (pace->waits == 0) {
+        return;
+    }
+    fprintf(out, "frame start error over %llu frames, worst %.3f ms, %llu resyncs\n",
+        (unsigned long long)pace->waits, pace->worst_ns / 1e6, (unsigned long long)pace->resyncs);
+    for (int b = 0; b < CHIP8_PACE_BUCKETS; b++) {
+        if (pace->histogram[b] == 0) {
+            continue;
+        }
+        double percent = 100.0 * pace->histogram[b] / pace->waits;
+        if (b < CHIP8_PACE_BUCKETS - 1) {
+            fprintf(out, "  <= %6.0f us %8llu  %6.2f%%\n", bucket_limits[b] / 1e3, (unsigned long long)pace->histogram[b], percent);
+        }
+        else {
+            fprintf(out, "   > %6.0f us %8llu  %6.2f%%\n", bucket_limits[b - 1] / 1e3, (unsigned long long)pace->histogram[b], percent);
+        }
+    }
+}
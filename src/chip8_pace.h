@@ -0,0 +1,44 @@
+#ifndef CHIP8_PACE_H
+#define CHIP8_PACE_H
+#include <stdint.h>
+#include <stdio.h>
+
+// frame pacing
+// frame n starts at an absolute deadline, epoch + n / hz, worked out in whole
+// nanoseconds from the start every time, so rounding never adds up and the rate
+// is exactly hz however long each frame took
+// the wait sleeps with clock_nanosleep(TIMER_ABSTIME) until a little before the
+// deadline and spins the rest, a sleeping thread wakes up late by anything from a
+// few microseconds to a scheduler tick, a spinning one doesn't
+// every frame start's distance from its deadline goes into a histogram
+
+// histogram buckets, by error up to 10us, 20us, 50us ... 20ms, and past that
+#define CHIP8_PACE_BUCKETS 12
+
+// a frame start more than this many frames late gives up on the ones it missed and
+// starts counting again from now, rather than running them back to back
+#define CHIP8_PACE_MAX_BEHIND 4
+
+typedef struct Chip8Pace {
+    int64_t epoch;   // CLOCK_MONOTONIC nanoseconds of frame 0's deadline
+    uint64_t frame;  // the frame waited for next, counted from the epoch
+    int hz;
+    int64_t spin_ns; // how long before a deadline the sleep ends and the spin starts
+
+    uint64_t histogram[CHIP8_PACE_BUCKETS];
+    uint64_t waits;
+    int64_t worst_ns;
+    uint64_t resyncs; // times it fell more than CHIP8_PACE_MAX_BEHIND frames behind
+} Chip8Pace;
+
+// first deadline is now, spin_ns of 0 sleeps all the way
+void chip8_pace_init(Chip8Pace* pace, int hz, int64_t spin_ns);
+
+// wait for the next frame's deadline and record how far off the wake up was
+// returns straight away when the frame is already late
+void chip8_pace_wait(Chip8Pace* pace);
+
+// print the error histogram, one line per bucket anything landed in
+void chip8_pace_print(const Chip8Pace* pace, FILE* out);
+
+#endif
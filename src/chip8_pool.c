@@ -0,0 +1,363 @@
+#include "./chip8_pool.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// take and steal results that aren't a chunk
+#define DEQUE_EMPTY -1
+#define DEQUE_ABORT -2
+
+// chunks per thread when the caller doesn't pick a chunk size
+#define CHUNKS_PER_THREAD 8
+
+// Chase-Lev work stealing deque of chunk indices
+// the owner pushes and takes at the bottom, other threads steal from the top
+// top and bottom only ever grow, so the ring is never reset between runs
+// memory orders follow Le, Pop, Cohen and Zappa Nardelli, PPoPP 2013
+typedef struct Chip8Deque {
+    _Alignas(64) _Atomic int64_t top;
+    _Alignas(64) _Atomic int64_t bottom;
+    _Alignas(64) _Atomic int32_t* ring;
+    int64_t mask;
+} Chip8Deque;
+
+typedef struct Chip8Worker {
+    Chip8Deque deque;
+    struct Chip8Pool* pool;
+    int index;
+    pthread_t thread;
+    uint32_t random; // victim selection
+
+    // results of the current run, read by the caller once every chunk is done
+    uint64_t executed;
+    uint64_t chunks;
+    uint64_t steals;
+} Chip8Worker;
+
+struct Chip8Pool {
+    Chip8Batch* batch;
+    int thread_count;
+    int chunk;
+    int chunk_count;
+    Chip8Worker* workers;
+
+    // the current run, set before the generation moves on
+    int frame_mode;
+    int cycles;
+    int cycles_per_frame;
+
+    // workers sleep on wake until the generation changes
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint64_t generation;
+    int quit;
+
+    // chunks not finished yet, and workers not back to sleep yet
+    _Alignas(64) _Atomic int remaining;
+    _Alignas(64) _Atomic int busy;
+
+    Chip8PoolStats stats;
+};
+
+static void deque_push(Chip8Deque* deque, int32_t chunk) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->ring[b & deque->mask], chunk, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+static int32_t deque_take(Chip8Deque* deque) {
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (t > b) {
+        // already empty
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+        return DEQUE_EMPTY;
+    }
+
+    int32_t chunk = atomic_load_explicit(&deque->ring[b & deque->mask], memory_order_relaxed);
+    if (t == b) {
+        // the last one, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed)) {
+            chunk = DEQUE_EMPTY;
+        }
+        atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    }
+    return chunk;
+}
+
+static int32_t deque_steal(Chip8Deque* deque) {
+    int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return DEQUE_EMPTY;
+    }
+    int32_t chunk = atomic_load_explicit(&deque->ring[t & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return DEQUE_ABORT;
+    }
+    return chunk;
+}
+
+// try every other thread once, starting from a random one
+static int32_t steal(Chip8Worker* worker) {
+    Chip8Pool* pool = worker->pool;
+    int count = pool->thread_count;
+
+    worker->random ^= worker->random << 13;
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    int start = worker->random % count;
+
+    int32_t result = DEQUE_EMPTY;
+    for (int i = 0; i < count; i++) {
+        int victim = (start + i) % count;
+        if (victim == worker->index) {
+            continue;
+        }
+        int32_t chunk = deque_steal(&pool->workers[victim].deque);
+        if (chunk >= 0) {
+            return chunk;
+        }
+        if (chunk == DEQUE_ABORT) {
+            result = DEQUE_ABORT;
+        }
+    }
+    return result;
+}
+
+static uint64_t run_chunk(Chip8Pool* pool, int32_t chunk) {
+    int begin = chunk * pool->chunk;
+    int end = begin + pool->chunk;
+    int count = chip8_batch_count(pool->batch);
+    if (end > count) {
+        end = count;
+    }
+
+    if (pool->frame_mode) {
+        return chip8_batch_run_frame_range(pool->batch, begin, end, pool->cycles_per_frame);
+    }
+    return chip8_batch_run_cycles_range(pool->batch, begin, end, pool->cycles, pool->cycles_per_frame);
+}
+
+// one run on one thread, deal this thread's share of the chunks into its own deque,
+// run them, then steal until every chunk in the pool is done
+static void work(Chip8Worker* worker) {
+    Chip8Pool* pool = worker->pool;
+
+    for (int c = worker->index; c < pool->chunk_count; c += pool->thread_count) {
+        deque_push(&worker->deque, c);
+    }
+
+    uint64_t executed = 0;
+    uint64_t chunks = 0;
+    uint64_t steals = 0;
+
+    while (atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0) {
+        int32_t chunk = deque_take(&worker->deque);
+        if (chunk < 0) {
+            chunk = steal(worker);
+            if (chunk == DEQUE_EMPTY) {
+                // the rest is being run elsewhere, or hasn't been dealt yet
+                sched_yield();
+            }
+            if (chunk < 0) {
+                continue;
+            }
+            steals++;
+        }
+
+        executed += run_chunk(pool, chunk);
+        chunks++;
+        atomic_fetch_sub_explicit(&pool->remaining, 1, memory_order_release);
+    }
+
+    worker->executed = executed;
+    worker->chunks = chunks;
+    worker->steals = steals;
+}
+
+static void* worker_main(void* arg) {
+    Chip8Worker* worker = arg;
+    Chip8Pool* pool = worker->pool;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(worker);
+        atomic_fetch_sub_explicit(&pool->busy, 1, memory_order_release);
+    }
+
+    return NULL;
+}
+
+int chip8_pool_cores(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+// tell the worker threads to quit and wait for them, started counts the caller
+static void stop_workers(Chip8Pool* pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+}
+
+// free the pool and the first rings deques, once no thread uses them
+static void free_pool(Chip8Pool* pool, int rings) {
+    for (int i = 0; i < rings; i++) {
+        free((void*)pool->workers[i].deque.ring);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+Chip8Pool* chip8_pool_create(Chip8Batch* batch, int threads, int chunk) {
+    int count = chip8_batch_count(batch);
+    if (threads <= 0) {
+        threads = chip8_pool_cores();
+    }
+    if (chunk <= 0) {
+        chunk = count / (threads * CHUNKS_PER_THREAD);
+        if (chunk < 1) {
+            chunk = 1;
+        }
+    }
+
+    Chip8Pool* pool = calloc(1, sizeof(Chip8Pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->batch = batch;
+    pool->thread_count = threads;
+    pool->chunk = chunk;
+    pool->chunk_count = (count + chunk - 1) / chunk;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    pool->workers = aligned_alloc(64, (size_t)threads * sizeof(Chip8Worker));
+    if (pool->workers == NULL) {
+        free_pool(pool, 0);
+        return NULL;
+    }
+
+    // a run pushes at most this many chunks into one deque, and they're all
+    // gone by the end of it, so the ring never wraps onto live entries
+    int64_t share = (pool->chunk_count + threads - 1) / threads;
+    int64_t size = 1;
+    while (size < share) {
+        size <<= 1;
+    }
+
+    for (int i = 0; i < threads; i++) {
+        Chip8Worker* worker = &pool->workers[i];
+        memset(worker, 0, sizeof(Chip8Worker));
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+        worker->deque.ring = calloc(size, sizeof(int32_t));
+        worker->deque.mask = size - 1;
+        worker->pool = pool;
+        worker->index = i;
+        worker->random = 2463534242u + i * 2654435761u;
+        if (worker->deque.ring == NULL) {
+            free_pool(pool, i);
+            return NULL;
+        }
+    }
+
+    // the caller is worker 0
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            stop_workers(pool, i);
+            free_pool(pool, threads);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+void chip8_pool_destroy(Chip8Pool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    stop_workers(pool, pool->thread_count);
+    free_pool(pool, pool->thread_count);
+}
+
+static uint64_t run(Chip8Pool* pool) {
+    atomic_store_explicit(&pool->remaining, pool->chunk_count, memory_order_relaxed);
+    atomic_store_explicit(&pool->busy, pool->thread_count - 1, memory_order_relaxed);
+
+    // the lock publishes the run parameters along with the new generation
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(&pool->workers[0]);
+
+    // every chunk is done, wait for the other threads to put down their results
+    while (atomic_load_explicit(&pool->busy, memory_order_acquire) > 0) {
+        sched_yield();
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < pool->thread_count; i++) {
+        total += pool->workers[i].executed;
+        pool->stats.chunks += pool->workers[i].chunks;
+        pool->stats.steals += pool->workers[i].steals;
+    }
+    pool->stats.runs++;
+    return total;
+}
+
+uint64_t chip8_pool_run_frame(Chip8Pool* pool, int cycles_per_frame) {
+    pool->frame_mode = 1;
+    pool->cycles_per_frame = cycles_per_frame;
+    return run(pool);
+}
+
+uint64_t chip8_pool_run_cycles(Chip8Pool* pool, int cycles, int cycles_per_frame) {
+    pool->frame_mode = 0;
+    pool->cycles = cycles;
+    pool->cycles_per_frame = cycles_per_frame;
+    return run(pool);
+}
+
+int chip8_pool_threads(const Chip8Pool* pool) {
+    return pool->thread_count;
+}
+
+void chip8_pool_stats(const Chip8Pool* pool, Chip8PoolStats* stats) {
+    *stats = pool->stats;
+}
@@ -0,0 +1,39 @@
+#ifndef CHIP8_POOL_H
+#define CHIP8_POOL_H
+#include <stdint.h>
+#include "./chip8_batch.h"
+
+// work stealing thread pool for a batch
+// each run call splits the batch into chunks of instances, deals the chunks out to
+// per thread deques, and threads that run out of work steal from the others,
+// so instances stalled on FX0A or finishing early don't leave cores idle
+// the calling thread works too, so a pool of 1 thread starts no threads
+
+typedef struct Chip8Pool Chip8Pool;
+
+// work stealing counters, summed over every run
+typedef struct Chip8PoolStats {
+    uint64_t runs;   // run calls
+    uint64_t chunks; // chunks executed
+    uint64_t steals; // chunks taken from another thread's deque
+} Chip8PoolStats;
+
+// threads is the number of threads including the caller, 0 for one per online core
+// chunk is the number of instances per unit of work, 0 for a default
+// the batch must outlive the pool
+// returns NULL if the memory or a thread can't be had, with nothing left running
+Chip8Pool* chip8_pool_create(Chip8Batch* batch, int threads, int chunk);
+void chip8_pool_destroy(Chip8Pool* pool);
+
+// chip8_batch_run_frame and chip8_batch_run_cycles spread over the pool's threads
+// they return once every instance has finished
+uint64_t chip8_pool_run_frame(Chip8Pool* pool, int cycles_per_frame);
+uint64_t chip8_pool_run_cycles(Chip8Pool* pool, int cycles, int cycles_per_frame);
+
+int chip8_pool_threads(const Chip8Pool* pool);
+void chip8_pool_stats(const Chip8Pool* pool, Chip8PoolStats* stats);
+
+// number of online cores, at least 1
+int chip8_pool_cores(void);
+
+#endif
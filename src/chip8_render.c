@@ -0,0 +1,96 @@
+#include "./chip8_render.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/gl.h>
+
+struct Chip8Renderer {
+    GLuint texture;
+    // one byte a pixel, laid out like the texture
+    uint8_t pixels[32][64];
+    uint64_t uploads;
+};
+
+Chip8Renderer* chip8_render_create(void) {
+    Chip8Renderer* renderer = malloc(sizeof(Chip8Renderer));
+    if (renderer == NULL) {
+        return NULL;
+    }
+    memset(renderer->pixels, 0, sizeof(renderer->pixels));
+    renderer->uploads = 0;
+
+    glGenTextures(1, &renderer->texture);
+    if (renderer->texture == 0) {
+        free(renderer);
+        return NULL;
+    }
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    // starts out black, the machine's rows all start out dirty anyway
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, 64, 32, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, renderer->pixels);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_TEXTURE_2D);
+
+    // the quad is drawn straight in clip space
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    return renderer;
+}
+
+void chip8_render_destroy(Chip8Renderer* renderer) {
+    if (renderer == NULL) {
+        return;
+    }
+    glDeleteTextures(1, &renderer->texture);
+    free(renderer);
+}
+
+int chip8_render_update(Chip8Renderer* renderer, const uint64_t* display, uint32_t rows) {
+    if (rows == 0) {
+        return 0;
+    }
+
+    // only the dirty rows are unpacked, then one upload covers the band from the
+    // first to the last, most frames change a few next to each other
+    int first = __builtin_ctz(rows);
+    int last = 31 - __builtin_clz(rows);
+    for (int y = first; y <= last; y++) {
+        if ((rows >> y) & 1) {
+            uint64_t row = display[y];
+            for (int x = 0; x < 64; x++) {
+                renderer->pixels[y][x] = (row >> (63 - x)) & 1 ? 0xFF : 0x00;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, 64, last - first + 1, GL_LUMINANCE, GL_UNSIGNED_BYTE, renderer->pixels[first]);
+    renderer->uploads++;
+    return 1;
+}
+
+void chip8_render_draw(Chip8Renderer* renderer) {
+    glBindTexture(GL_TEXTURE_2D, renderer->texture);
+
+    // row 0 of the texture is the top of the screen
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0);
+    glVertex2f(-1, 1);
+    glTexCoord2f(1, 0);
+    glVertex2f(1, 1);
+    glTexCoord2f(1, 1);
+    glVertex2f(1, -1);
+    glTexCoord2f(0, 1);
+    glVertex2f(-1, -1);
+    glEnd();
+}
+
+uint64_t chip8_render_uploads(const Chip8Renderer* renderer) {
+    return renderer->uploads;
+}
@@ -0,0 +1,32 @@
+#ifndef CHIP8_RENDER_H
+#define CHIP8_RENDER_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// opengl renderer
+// the display lives in a 64x32 luminance texture, one byte a pixel, drawn as a
+// single quad stretched over the viewport with nearest filtering
+// a frame costs one quad instead of two triangles per lit pixel, and the texture
+// is only uploaded when the display changed, then only the rows that did,
+// going by the dirty rows of the machine or frame it comes from
+// sticks to opengl 1.1 so it runs on mesa's software rasterizer too
+
+typedef struct Chip8Renderer Chip8Renderer;
+
+// needs a current GL context, sets up the texture and the matrices the quad is drawn with
+// returns NULL if the texture can't be made
+Chip8Renderer* chip8_render_create(void);
+void chip8_render_destroy(Chip8Renderer* renderer);
+
+// upload the rows of a packed display set in rows, e.g. from chip8_take_dirty_rows
+// or a Chip8Frame
+// returns 1 if anything changed, otherwise the last frame drawn is still right
+int chip8_render_update(Chip8Renderer* renderer, const uint64_t* display, uint32_t rows);
+
+// draw the texture over the whole viewport
+void chip8_render_draw(Chip8Renderer* renderer);
+
+// texture uploads so far, an update with no dirty rows doesn't upload
+uint64_t chip8_render_uploads(const Chip8Renderer* renderer);
+
+#endif
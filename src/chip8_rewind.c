@@ -0,0 +1,248 @@
+#include "./chip8_rewind.h"
+#include "./chip8_state.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the part of a state a delta covers, the header is rebuilt on the way back
+#define BODY_OFFSET offsetof(Chip8State, display)
+#define BODY_SIZE (sizeof(Chip8State) - BODY_OFFSET)
+
+// an encoded delta is never more than a few bytes bigger than the body
+#define MAX_DELTA (BODY_SIZE + 8)
+
+// each delta in the ring has its length before and after it, so the oldest can
+// be dropped from the front and the newest popped from the back
+#define LENGTH_SIZE sizeof(uint32_t)
+
+// unchanged bytes shorter than this stay inside a run, a new run header costs as much
+#define MIN_GAP 3
+
+struct Chip8Rewind {
+    uint8_t* ring;
+    size_t size;
+    size_t head; // where the next delta goes
+    size_t used;
+    int frames;
+
+    // the newest capture in full, and the one being taken
+    Chip8State states[2];
+    int newest;
+    int have_newest;
+
+    uint8_t diff[BODY_SIZE];
+    uint8_t delta[MAX_DELTA];
+};
+
+static uint8_t* body(Chip8State* state) {
+    return (uint8_t*)state + BODY_OFFSET;
+}
+
+// copies in and out of the ring, wrapping at the end
+static void ring_put(Chip8Rewind* rewind, size_t offset, const void* src, size_t len) {
+    size_t first = rewind->size - offset < len ? rewind->size - offset : len;
+    memcpy(rewind->ring + offset, src, first);
+    memcpy(rewind->ring, (const uint8_t*)src + first, len - first);
+}
+
+static void ring_get(const Chip8Rewind* rewind, size_t offset, void* dst, size_t len) {
+    size_t first = rewind->size - offset < len ? rewind->size - offset : len;
+    memcpy(dst, rewind->ring + offset, first);
+    memcpy((uint8_t*)dst + first, rewind->ring, len - first);
+}
+
+static size_t ring_back(const Chip8Rewind* rewind, size_t offset, size_t len) {
+    return (offset + rewind->size - len) % rewind->size;
+}
+
+// LEB128, 7 bits a byte, low bits first
+static size_t put_varint(uint8_t* out, size_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static size_t get_varint(const uint8_t* in, size_t* value) {
+    size_t n = 0;
+    int shift = 0;
+    *value = 0;
+    do {
+        *value |= (size_t)(in[n] & 0x7F) << shift;
+        shift += 7;
+    } while (in[n++] & 0x80);
+    return n;
+}
+
+// runs of changed bytes, each as (unchanged bytes before it, its length, its bytes)
+// unchanged stretches are skipped a word at a time, which is nearly all of them
+static size_t encode(const uint8_t* diff, size_t size, uint8_t* out) {
+    size_t n = 0;
+    size_t last = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        if ((i & 7) == 0 && i + 8 <= size) {
+            uint64_t word;
+            memcpy(&word, diff + i, 8);
+            if (word == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        if (diff[i] == 0) {
+            i++;
+            continue;
+        }
+
+        size_t end = i + 1;
+        for (size_t j = end; j < size && j - end < MIN_GAP; j++) {
+            if (diff[j] != 0) {
+                end = j + 1;
+            }
+        }
+
+        n += put_varint(out + n, i - last);
+        n += put_varint(out + n, end - i);
+        memcpy(out + n, diff + i, end - i);
+        n += end - i;
+        last = end;
+        i = end;
+    }
+
+    return n;
+}
+
+// xor the runs back into a body
+static void apply(const uint8_t* in, size_t len, uint8_t* target) {
+    size_t n = 0;
+    size_t pos = 0;
+
+    while (n < len) {
+        size_t skip, count;
+        n += get_varint(in + n, &skip);
+        n += get_varint(in + n, &count);
+        pos += skip;
+        for (size_t k = 0; k < count; k++) {
+            target[pos + k] ^= in[n + k];
+        }
+        n += count;
+        pos += count;
+    }
+}
+
+Chip8Rewind* chip8_rewind_create(size_t bytes) {
+    // room for a few worst case deltas, so one never has to be turned away
+    if (bytes < 4 * (MAX_DELTA + 2 * LENGTH_SIZE)) {
+        bytes = 4 * (MAX_DELTA + 2 * LENGTH_SIZE);
+    }
+
+    Chip8Rewind* rewind = malloc(sizeof(Chip8Rewind));
+    if (rewind == NULL) {
+        return NULL;
+    }
+    rewind->ring = malloc(bytes);
+    if (rewind->ring == NULL) {
+        free(rewind);
+        return NULL;
+    }
+    rewind->size = bytes;
+    chip8_rewind_clear(rewind);
+    return rewind;
+}
+
+void chip8_rewind_destroy(Chip8Rewind* rewind) {
+    if (rewind == NULL) {
+        return;
+    }
+    free(rewind->ring);
+    free(rewind);
+}
+
+void chip8_rewind_clear(Chip8Rewind* rewind) {
+    rewind->head = 0;
+    rewind->used = 0;
+    rewind->frames = 0;
+    rewind->newest = 0;
+    rewind->have_newest = 0;
+}
+
+static void drop_oldest(Chip8Rewind* rewind) {
+    uint32_t len;
+    ring_get(rewind, ring_back(rewind, rewind->head, rewind->used), &len, LENGTH_SIZE);
+    rewind->used -= len + 2 * LENGTH_SIZE;
+    rewind->frames--;
+}
+
+int chip8_rewind_capture(Chip8Rewind* rewind, const Chip8* chip8) {
+    Chip8State* newest = &rewind->states[rewind->newest];
+    Chip8State* capture = &rewind->states[!rewind->newest];
+    if (chip8_save_state(chip8, capture) != 0) {
+        return -1;
+    }
+
+    if (rewind->have_newest) {
+        // the delta takes the new state back to the one before it
+        const uint8_t* a = body(newest);
+        const uint8_t* b = body(capture);
+        for (size_t i = 0; i < BODY_SIZE; i += 8) {
+            uint64_t x, y;
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            x ^= y;
+            memcpy(rewind->diff + i, &x, 8);
+        }
+        uint32_t len = (uint32_t)encode(rewind->diff, BODY_SIZE, rewind->delta);
+
+        size_t need = len + 2 * LENGTH_SIZE;
+        while (rewind->used + need > rewind->size) {
+            drop_oldest(rewind);
+        }
+
+        size_t at = rewind->head;
+        ring_put(rewind, at, &len, LENGTH_SIZE);
+        ring_put(rewind, (at + LENGTH_SIZE) % rewind->size, rewind->delta, len);
+        ring_put(rewind, (at + LENGTH_SIZE + len) % rewind->size, &len, LENGTH_SIZE);
+        rewind->head = (at + need) % rewind->size;
+        rewind->used += need;
+        rewind->frames++;
+    }
+
+    rewind->newest = !rewind->newest;
+    rewind->have_newest = 1;
+    return 0;
+}
+
+int chip8_rewind_step_back(Chip8Rewind* rewind, Chip8* chip8) {
+    if (rewind->frames == 0) {
+        return -1;
+    }
+
+    uint32_t len;
+    ring_get(rewind, ring_back(rewind, rewind->head, LENGTH_SIZE), &len, LENGTH_SIZE);
+    size_t at = ring_back(rewind, rewind->head, len + 2 * LENGTH_SIZE);
+    ring_get(rewind, (at + LENGTH_SIZE) % rewind->size, rewind->delta, len);
+
+    Chip8State* newest = &rewind->states[rewind->newest];
+    apply(rewind->delta, len, body(newest));
+    newest->checksum = chip8_state_checksum(newest);
+
+    rewind->head = at;
+    rewind->used -= len + 2 * LENGTH_SIZE;
+    rewind->frames--;
+
+    chip8_load_state(chip8, newest);
+    return 0;
+}
+
+int chip8_rewind_frames(const Chip8Rewind* rewind) {
+    return rewind->frames;
+}
+
+size_t chip8_rewind_used(const Chip8Rewind* rewind) {
+    return rewind->used;
+}
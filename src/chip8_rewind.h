@@ -0,0 +1,35 @@
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+#include <stddef.h>
+#include <stdint.h>
+#include "./chip8.h"
+
+// rewind history
+// keeps the last captured state in full and, in a fixed size ring of bytes, the
+// xor of every earlier capture with the one after it, run length encoded
+// consecutive frames differ in a handful of bytes, so a delta is usually a few
+// dozen bytes and an hour of play fits in a few megabytes
+// stepping back undoes the newest delta, when the ring is full the oldest go
+
+typedef struct Chip8Rewind Chip8Rewind;
+
+// bytes is the size of the delta ring, at least a few full states
+Chip8Rewind* chip8_rewind_create(size_t bytes);
+void chip8_rewind_destroy(Chip8Rewind* rewind);
+
+// record the machine as the newest frame, called once per frame
+// returns -1 if the machine can't be saved (see chip8_save_state), 0 otherwise
+int chip8_rewind_capture(Chip8Rewind* rewind, const Chip8* chip8);
+
+// put the machine back to the frame before the newest one, which becomes the newest
+// returns -1 with the machine untouched once there is nothing left to go back to
+int chip8_rewind_step_back(Chip8Rewind* rewind, Chip8* chip8);
+
+// forget everything, the next capture starts over
+void chip8_rewind_clear(Chip8Rewind* rewind);
+
+// frames that can be stepped back, and ring bytes in use
+int chip8_rewind_frames(const Chip8Rewind* rewind);
+size_t chip8_rewind_used(const Chip8Rewind* rewind);
+
+#endif
@@ -0,0 +1,92 @@
+#include "./chip8_sched.h"
+#include <stddef.h>
+#include <stdint.h>
+
+void chip8_sched_init(Chip8Sched* sched, int cycles_per_tick) {
+    sched->clock = 0;
+    sched->next_tick = 0;
+    sched->cycles_per_tick = cycles_per_tick;
+    sched->display_wait = 1;
+    sched->drawn = 0;
+    sched->run = chip8_run_cycles;
+    sched->input = NULL;
+}
+
+void chip8_sched_seek(Chip8Sched* sched, uint64_t clock) {
+    sched->clock = clock;
+    sched->next_tick = clock;
+    sched->drawn = 0;
+    if (sched->input) {
+        chip8_input_set_clock(sched->input, clock);
+    }
+}
+
+// fire everything due at the current cycle
+static void fire(Chip8Sched* sched, Chip8* chip8) {
+    while (sched->next_tick <= sched->clock) {
+        chip8_tick_timers(chip8);
+        sched->drawn = 0;
+        sched->next_tick += sched->cycles_per_tick;
+    }
+    if (sched->input) {
+        chip8_input_set_clock(sched->input, sched->clock);
+        chip8_input_apply(sched->input, chip8);
+    }
+}
+
+// let time pass up to until without running anything, ticking the timers for
+// every tick before it, the one at until fires with everything else due then
+static void pass(Chip8Sched* sched, Chip8* chip8, uint64_t until) {
+    if (sched->next_tick < until) {
+        uint64_t ticks = (until - 1 - sched->next_tick) / sched->cycles_per_tick + 1;
+        // past 255 ticks both timers are 0 whatever they started at
+        for (uint64_t t = 0; t < ticks && t < 256; t++) {
+            chip8_tick_timers(chip8);
+        }
+        sched->next_tick += ticks * sched->cycles_per_tick;
+        sched->drawn = 0;
+    }
+    sched->clock = until;
+}
+
+uint64_t chip8_sched_run(Chip8Sched* sched, Chip8* chip8, uint64_t cycles) {
+    uint64_t end = sched->clock + cycles;
+    uint64_t executed = 0;
+
+    while (sched->clock < end) {
+        fire(sched, chip8);
+
+        // the next key change, events due now were just applied
+        uint64_t key_at = end;
+        uint64_t at;
+        if (sched->input && chip8_input_next(sched->input, &at) && at < key_at) {
+            key_at = at;
+        }
+
+        // only a key can move a machine on FX0A, the ticks on the way just count down
+        if (chip8_key_blocked(chip8)) {
+            pass(sched, chip8, key_at);
+            continue;
+        }
+
+        uint64_t next = sched->next_tick < key_at ? sched->next_tick : key_at;
+        if (sched->drawn) {
+            pass(sched, chip8, next);
+            continue;
+        }
+
+        // never more than a tick, so it fits the interpreter's int
+        int ran;
+        Chip8Status status = sched->run(chip8, (int)(next - sched->clock), &ran);
+        sched->clock += ran;
+        executed += ran;
+        if (status == CHIP8_DRAW && sched->display_wait) {
+            sched->drawn = 1;
+        }
+    }
+
+    if (sched->input) {
+        chip8_input_set_clock(sched->input, sched->clock);
+    }
+    return executed;
+}
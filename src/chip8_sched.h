@@ -0,0 +1,37 @@
+#ifndef CHIP8_SCHED_H
+#define CHIP8_SCHED_H
+#include <stdint.h>
+#include "./chip8.h"
+#include "./chip8_input.h"
+
+// event scheduler
+// drives a machine by emulated time instead of by host frames
+// time is counted in cycles, one instruction's worth each, and the 60hz timer
+// tick, the vertical blank that ends the display wait and queued key changes
+// each fire on the exact cycle they are due, however the host slices the time up,
+// so a window, a turbo key, a batch and a headless run all see the same machine
+// a machine stalled on a draw or on FX0A lets cycles pass without running anything
+
+typedef struct Chip8Sched {
+    uint64_t clock;      // cycles since the start
+    uint64_t next_tick;  // cycle of the next timer tick and vertical blank
+    int cycles_per_tick; // cycles in a 60hz tick
+    int display_wait;    // 1 to stall after a draw until the next vertical blank
+    int drawn;           // stalled after a draw
+    Chip8RunFn run;      // interpreter, chip8_run_cycles by default
+    Chip8Input* input;   // key changes to apply as they come due, NULL for none
+} Chip8Sched;
+
+// clock at 0 with a tick due straight away, display wait on, no input queue
+void chip8_sched_init(Chip8Sched* sched, int cycles_per_tick);
+
+// run the machine until the clock has moved on by cycles, firing every event
+// due on the way, returns the instructions executed
+// with display_wait on, cycles_per_tick cycles from a tick is exactly chip8_run_frame
+uint64_t chip8_sched_run(Chip8Sched* sched, Chip8* chip8, uint64_t cycles);
+
+// move the clock, which has to be on a tick, e.g. after loading a state
+// captured at the start of a frame
+void chip8_sched_seek(Chip8Sched* sched, uint64_t clock);
+
+#endif
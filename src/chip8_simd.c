@@ -0,0 +1,550 @@
+#include "./chip8_simd.h"
+#include "./chip8_ops.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// lanes per block, one block fills one vector register
+// anything wider gets its compares split into one per lane by GCC
+#if defined(__AVX512BW__)
+#define WIDTH 32
+#elif defined(__AVX2__)
+#define WIDTH 16
+#else
+#define WIDTH 8
+#endif
+
+// every register is kept 16 bits wide, so V, I, pc and the masks all share one
+// vector type and nothing needs widening, which AVX2 can't do in one instruction
+// 8 bit results are cut back down with & 0xFF
+typedef uint16_t lanes_t __attribute__((vector_size(WIDTH * 2)));
+typedef int16_t signed_lanes_t __attribute__((vector_size(WIDTH * 2)));
+
+// the instruction counters are 16 bit too, so long frames run in slices
+#define MAX_SLICE 0xFFFF
+
+// registers of WIDTH lanes, element n of every vector belongs to lane n of the block
+// masks are 0xFFFF for lanes that take part, 0 for the rest
+typedef struct Chip8SimdBlock {
+    lanes_t V[16];
+    lanes_t I;
+    lanes_t pc;
+    lanes_t keys;
+    lanes_t delay_timer;
+    lanes_t sound_timer;
+    lanes_t live;     // lanes that can still run this slice
+    lanes_t stopped;  // lanes that drew or are waiting on a key, done for the frame
+    lanes_t executed; // instructions run this slice
+} Chip8SimdBlock;
+
+struct Chip8Simd {
+    Chip8SimdBlock* blocks;
+    int block_count;
+    int lanes;
+
+    // memory, stack and display of every lane, and the registers for chip8_step
+    Chip8* machines;
+
+    // CXNN generator of every lane, side by side so a block fills at once
+    // padded to whole blocks, copied to and from the machines with the registers
+    uint32_t* rng;
+
+    // addresses any lane has stored to, code there may differ between lanes
+    uint8_t written[4096];
+
+    // lanes at the pc being run, per block
+    lanes_t* group;
+    uint8_t* group_any;
+
+    Chip8SimdStats stats;
+};
+
+// new where the mask is set, old elsewhere
+// a macro rather than a function, vector arguments wider than the target's
+// registers change the calling convention
+#define BLEND(old, new, m) (((new) & (m)) | ((old) & ~(m)))
+
+// comparisons give 0 or -1 per lane, as a mask
+#define MASK(cmp) ((lanes_t)(cmp))
+
+// unsigned a < b, x86 only has signed 16 bit compares so both sides are biased
+// (a plain unsigned compare gets split up into one compare per lane)
+#define LESS(a, b) MASK((signed_lanes_t)((a) ^ 0x8000) < (signed_lanes_t)((b) ^ 0x8000))
+
+static inline int mask_count(const lanes_t* m) {
+    uint64_t words[WIDTH / 4];
+    memcpy(words, m, sizeof(words));
+    int count = 0;
+    for (int i = 0; i < WIDTH / 4; i++) {
+        count += __builtin_popcountll(words[i]);
+    }
+    return count / 16;
+}
+
+static inline int mask_any(const lanes_t* m) {
+    uint64_t words[WIDTH / 4];
+    memcpy(words, m, sizeof(words));
+    uint64_t any = 0;
+    for (int i = 0; i < WIDTH / 4; i++) {
+        any |= words[i];
+    }
+    return any != 0;
+}
+
+// aligned_alloc wants a size that is a multiple of the alignment, a lanes_t is
+// only 16 bytes at WIDTH 8, so neither array size is one on its own
+static size_t round_up_64(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+Chip8Simd* chip8_simd_create(int lanes) {
+    if (lanes <= 0) {
+        return NULL;
+    }
+    Chip8Simd* simd = calloc(1, sizeof(Chip8Simd));
+    if (simd == NULL) {
+        return NULL;
+    }
+    simd->lanes = lanes;
+    simd->block_count = (lanes + WIDTH - 1) / WIDTH;
+
+    simd->blocks = aligned_alloc(64, round_up_64((size_t)simd->block_count * sizeof(Chip8SimdBlock)));
+    simd->group = aligned_alloc(64, round_up_64((size_t)simd->block_count * sizeof(lanes_t)));
+    simd->group_any = malloc(simd->block_count);
+    simd->machines = malloc((size_t)lanes * sizeof(Chip8));
+    simd->rng = malloc((size_t)simd->block_count * WIDTH * sizeof(uint32_t));
+    if (!simd->blocks || !simd->group || !simd->group_any || !simd->machines || !simd->rng) {
+        chip8_simd_destroy(simd);
+        return NULL;
+    }
+    memset(simd->blocks, 0, (size_t)simd->block_count * sizeof(Chip8SimdBlock));
+
+    for (int lane = 0; lane < simd->block_count * WIDTH; lane++) {
+        simd->rng[lane] = 1;
+    }
+    for (int lane = 0; lane < lanes; lane++) {
+        Chip8* chip8 = &simd->machines[lane];
+        chip8_init(chip8);
+        simd->blocks[lane / WIDTH].pc[lane % WIDTH] = chip8->pc;
+        simd->rng[lane] = chip8->rng;
+    }
+
+    return simd;
+}
+
+void chip8_simd_destroy(Chip8Simd* simd) {
+    if (simd == NULL) {
+        return;
+    }
+    free(simd->blocks);
+    free(simd->group);
+    free(simd->group_any);
+    free(simd->machines);
+    free(simd->rng);
+    free(simd);
+}
+
+void chip8_simd_load_rom(Chip8Simd* simd, const char* filename) {
+    load_rom(&simd->machines[0], filename);
+    for (int lane = 1; lane < simd->lanes; lane++) {
+        memcpy(&simd->machines[lane].memory[0x200], &simd->machines[0].memory[0x200], 4096 - 0x200);
+    }
+    memset(simd->written, 0, sizeof(simd->written));
+}
+
+void chip8_simd_set_keys(Chip8Simd* simd, const uint16_t* keys) {
+    for (int lane = 0; lane < simd->lanes; lane++) {
+        simd->blocks[lane / WIDTH].keys[lane % WIDTH] = keys[lane];
+        simd->machines[lane].keys = keys[lane];
+    }
+}
+
+void chip8_simd_seed(Chip8Simd* simd, uint64_t seed) {
+    for (int lane = 0; lane < simd->lanes; lane++) {
+        chip8_seed(&simd->machines[lane], seed + lane);
+        simd->rng[lane] = simd->machines[lane].rng;
+    }
+}
+
+// copy a lane's registers between its block and its Chip8
+static void lane_to_machine(Chip8Simd* simd, int lane) {
+    Chip8SimdBlock* block = &simd->blocks[lane / WIDTH];
+    Chip8* chip8 = &simd->machines[lane];
+    int n = lane % WIDTH;
+    for (int i = 0; i < 16; i++) {
+        chip8->V[i] = block->V[i][n];
+    }
+    chip8->I = block->I[n];
+    chip8->pc = block->pc[n];
+    chip8->keys = block->keys[n];
+    chip8->delay_timer = block->delay_timer[n];
+    chip8->sound_timer = block->sound_timer[n];
+    chip8->rng = simd->rng[lane];
+}
+
+static void machine_to_lane(Chip8Simd* simd, int lane) {
+    Chip8SimdBlock* block = &simd->blocks[lane / WIDTH];
+    Chip8* chip8 = &simd->machines[lane];
+    int n = lane % WIDTH;
+    for (int i = 0; i < 16; i++) {
+        block->V[i][n] = chip8->V[i];
+    }
+    block->I[n] = chip8->I;
+    block->pc[n] = chip8->pc;
+    block->delay_timer[n] = chip8->delay_timer;
+    block->sound_timer[n] = chip8->sound_timer;
+    simd->rng[lane] = chip8->rng;
+}
+
+Chip8* chip8_simd_machine(Chip8Simd* simd, int lane) {
+    lane_to_machine(simd, lane);
+    return &simd->machines[lane];
+}
+
+void chip8_simd_stats(const Chip8Simd* simd, Chip8SimdStats* stats) {
+    *stats = simd->stats;
+}
+
+// run the instruction through chip8_step on every lane of the group
+// returns the instructions executed, lanes waiting on a key don't count
+static int run_scalar(Chip8Simd* simd, int cycles) {
+    int total = 0;
+
+    for (int b = 0; b < simd->block_count; b++) {
+        if (!simd->group_any[b]) {
+            continue;
+        }
+        Chip8SimdBlock* block = &simd->blocks[b];
+        for (int n = 0; n < WIDTH; n++) {
+            if (!simd->group[b][n]) {
+                continue;
+            }
+            int lane = b * WIDTH + n;
+            Chip8* chip8 = &simd->machines[lane];
+            lane_to_machine(simd, lane);
+
+            uint16_t opcode = FETCH_OPCODE();
+            uint16_t I = chip8->I;
+            Chip8Status status = chip8_step(chip8);
+            machine_to_lane(simd, lane);
+
+            // stores can change code, remember where they went
+            Chip8Op op = chip8_decode_op(opcode);
+            if (op == CHIP8_OP_FX33 || op == CHIP8_OP_FX55) {
+                int len = op == CHIP8_OP_FX33 ? 3 : EXTRACT_X(opcode) + 1;
+                for (int i = 0; i < len; i++) {
+                    simd->written[(I + i) & 0xFFF] = 1;
+                }
+            }
+
+            if (status == CHIP8_KEY_WAIT) {
+                block->live[n] = 0;
+                block->stopped[n] = 0xFFFF;
+                continue;
+            }
+            total++;
+            block->executed[n]++;
+            if (status == CHIP8_DRAW) {
+                block->live[n] = 0;
+                block->stopped[n] = 0xFFFF;
+            }
+            if (block->executed[n] >= cycles) {
+                block->live[n] = 0;
+            }
+        }
+    }
+
+    return total;
+}
+
+// run the instruction as vector operations on every block with lanes in the group
+// returns 0 for instructions that need chip8_step
+static int run_vector(Chip8Simd* simd, uint16_t opcode, Chip8Op op, int cycles) {
+    int x = EXTRACT_X(opcode);
+    int y = EXTRACT_Y(opcode);
+    lanes_t nn = (lanes_t){} + EXTRACT_NN(opcode);
+    lanes_t nnn = (lanes_t){} + EXTRACT_NNN(opcode);
+    lanes_t budget = (lanes_t){} + (uint16_t)cycles;
+
+    switch (op) {
+        case CHIP8_OP_00E0:
+        case CHIP8_OP_DXYN:
+        case CHIP8_OP_FX0A:
+        case CHIP8_OP_FX33:
+        case CHIP8_OP_FX55:
+        case CHIP8_OP_FX65:
+            return 0;
+        default:
+            break;
+    }
+
+    for (int b = 0; b < simd->block_count; b++) {
+        if (!simd->group_any[b]) {
+            continue;
+        }
+        Chip8SimdBlock* block = &simd->blocks[b];
+        lanes_t m = simd->group[b];
+        lanes_t vx = block->V[x];
+        lanes_t vy = block->V[y];
+
+        // the fetch moves every lane on, jumps and skips change it again below
+        lanes_t pc = block->pc + 2;
+        // lanes that skip the next instruction
+        lanes_t skip = (lanes_t){};
+
+        switch (op) {
+            case CHIP8_OP_00EE:
+                for (int n = 0; n < WIDTH; n++) {
+                    if (m[n]) {
+                        pc[n] = chip8_pop(&simd->machines[b * WIDTH + n]);
+                    }
+                }
+                break;
+            case CHIP8_OP_1NNN:
+                pc = nnn;
+                break;
+            case CHIP8_OP_2NNN:
+                for (int n = 0; n < WIDTH; n++) {
+                    if (m[n]) {
+                        chip8_push(&simd->machines[b * WIDTH + n], pc[n]);
+                    }
+                }
+                pc = nnn;
+                break;
+            case CHIP8_OP_3XNN:
+                skip = MASK(vx == nn);
+                break;
+            case CHIP8_OP_4XNN:
+                skip = MASK(vx != nn);
+                break;
+            case CHIP8_OP_5XY0:
+                skip = MASK(vx == vy);
+                break;
+            case CHIP8_OP_9XY0:
+                skip = MASK(vx != vy);
+                break;
+            case CHIP8_OP_6XNN:
+                block->V[x] = BLEND(vx, nn, m);
+                break;
+            case CHIP8_OP_7XNN:
+                block->V[x] = BLEND(vx, (vx + nn) & 0xFF, m);
+                break;
+            case CHIP8_OP_8XY0:
+                block->V[x] = BLEND(vx, vy, m);
+                break;
+            case CHIP8_OP_8XY1:
+                block->V[x] = BLEND(vx, vx | vy, m);
+                block->V[0xF] &= ~m;
+                break;
+            case CHIP8_OP_8XY2:
+                block->V[x] = BLEND(vx, vx & vy, m);
+                block->V[0xF] &= ~m;
+                break;
+            case CHIP8_OP_8XY3:
+                block->V[x] = BLEND(vx, vx ^ vy, m);
+                block->V[0xF] &= ~m;
+                break;
+            case CHIP8_OP_8XY4: {
+                lanes_t sum = vx + vy;
+                block->V[x] = BLEND(vx, sum & 0xFF, m);
+                block->V[0xF] = BLEND(block->V[0xF], sum >> 8, m);
+                break;
+            }
+            case CHIP8_OP_8XY5:
+                block->V[x] = BLEND(vx, (vx - vy) & 0xFF, m);
+                block->V[0xF] = BLEND(block->V[0xF], ~LESS(vx, vy) & 1, m);
+                break;
+            case CHIP8_OP_8XY7:
+                block->V[x] = BLEND(vx, (vy - vx) & 0xFF, m);
+                block->V[0xF] = BLEND(block->V[0xF], ~LESS(vy, vx) & 1, m);
+                break;
+            case CHIP8_OP_8XY6:
+                block->V[x] = BLEND(vx, vx >> 1, m);
+                block->V[0xF] = BLEND(block->V[0xF], vx & 1, m);
+                break;
+            case CHIP8_OP_8XYE:
+                block->V[x] = BLEND(vx, (vx << 1) & 0xFF, m);
+                block->V[0xF] = BLEND(block->V[0xF], vx >> 7, m);
+                break;
+            case CHIP8_OP_ANNN:
+                block->I = BLEND(block->I, nnn, m);
+                break;
+            case CHIP8_OP_BNNN:
+                pc = block->V[0] + nnn;
+                break;
+            case CHIP8_OP_CXNN: {
+                // the whole block's generators step, lanes outside the group keep their old state
+                uint32_t* states = &simd->rng[b * WIDTH];
+                uint32_t next[WIDTH];
+                uint8_t bytes[WIDTH];
+                memcpy(next, states, sizeof(next));
+                chip8_random_fill(next, bytes, WIDTH);
+
+                lanes_t r;
+                for (int n = 0; n < WIDTH; n++) {
+                    r[n] = bytes[n];
+                    if (m[n]) {
+                        states[n] = next[n];
+                    }
+                }
+                block->V[x] = BLEND(vx, r & nn, m);
+                break;
+            }
+            case CHIP8_OP_EX9E:
+            case CHIP8_OP_EXA1: {
+                // one key at a time, per lane shift counts are AVX-512 only
+                lanes_t key = vx & 0xF;
+                lanes_t held = (lanes_t){};
+                for (int k = 0; k < 16; k++) {
+                    held |= MASK(key == (uint16_t)k) & MASK((block->keys & (uint16_t)(1 << k)) != 0);
+                }
+                skip = op == CHIP8_OP_EX9E ? held : ~held;
+                break;
+            }
+            case CHIP8_OP_FX07:
+                block->V[x] = BLEND(vx, block->delay_timer, m);
+                break;
+            case CHIP8_OP_FX15:
+                block->delay_timer = BLEND(block->delay_timer, vx, m);
+                break;
+            case CHIP8_OP_FX18:
+                block->sound_timer = BLEND(block->sound_timer, vx, m);
+                break;
+            case CHIP8_OP_FX1E:
+                block->I = BLEND(block->I, block->I + vx, m);
+                break;
+            case CHIP8_OP_FX29:
+                block->I = BLEND(block->I, 0x050 + vx * 5, m);
+                break;
+            default:
+                break;
+        }
+
+        pc += skip & 2;
+        block->pc = BLEND(block->pc, pc, m);
+
+        // out of budget lanes stop for the slice
+        block->executed -= m;
+        block->live &= LESS(block->executed, budget);
+    }
+
+    return 1;
+}
+
+// run one instruction for the lanes at the lowest pc
+// returns 0 once every lane has stopped for the slice
+static int step(Chip8Simd* simd, int cycles) {
+    // lowest pc of the lanes still running, and how many are
+    lanes_t lowest = (lanes_t){} + 0xFFFF;
+    int live = 0;
+    for (int b = 0; b < simd->block_count; b++) {
+        Chip8SimdBlock* block = &simd->blocks[b];
+        lanes_t pc = block->pc | ~block->live;
+        lowest = BLEND(lowest, pc, LESS(pc, lowest));
+        live += mask_count(&block->live);
+    }
+    if (live == 0) {
+        return 0;
+    }
+
+    uint16_t target = 0xFFFF;
+    for (int n = 0; n < WIDTH; n++) {
+        if (lowest[n] < target) {
+            target = lowest[n];
+        }
+    }
+
+    // every running lane at that pc, the first one supplies the opcode
+    int leader = -1;
+    for (int b = 0; b < simd->block_count; b++) {
+        Chip8SimdBlock* block = &simd->blocks[b];
+        lanes_t m = block->live & MASK(block->pc == target);
+        simd->group[b] = m;
+        simd->group_any[b] = mask_any(&m);
+        if (simd->group_any[b] && leader < 0) {
+            for (int n = 0; n < WIDTH; n++) {
+                if (m[n]) {
+                    leader = b * WIDTH + n;
+                    break;
+                }
+            }
+        }
+    }
+
+    const uint8_t* memory = simd->machines[leader].memory;
+    uint8_t hi = memory[target & 0xFFF];
+    uint8_t lo = memory[(target + 1) & 0xFFF];
+    uint16_t opcode = hi << 8 | lo;
+
+    // if a lane stored over this address, only the lanes holding the same opcode go now
+    if (simd->written[target & 0xFFF] || simd->written[(target + 1) & 0xFFF]) {
+        for (int b = 0; b < simd->block_count; b++) {
+            if (!simd->group_any[b]) {
+                continue;
+            }
+            for (int n = 0; n < WIDTH; n++) {
+                const uint8_t* lane_memory = simd->machines[b * WIDTH + n].memory;
+                if (simd->group[b][n] && (lane_memory[target & 0xFFF] != hi || lane_memory[(target + 1) & 0xFFF] != lo)) {
+                    simd->group[b][n] = 0;
+                }
+            }
+            simd->group_any[b] = mask_any(&simd->group[b]);
+        }
+    }
+
+    int size = 0;
+    for (int b = 0; b < simd->block_count; b++) {
+        if (simd->group_any[b]) {
+            size += mask_count(&simd->group[b]);
+        }
+    }
+
+    simd->stats.steps++;
+    simd->stats.live_lanes += live;
+    simd->stats.divergent_steps += size < live;
+
+    if (run_vector(simd, opcode, chip8_decode_op(opcode), cycles)) {
+        simd->stats.vector_steps++;
+        simd->stats.lane_instructions += size;
+    }
+    else {
+        simd->stats.scalar_steps++;
+        simd->stats.lane_instructions += run_scalar(simd, cycles);
+    }
+
+    return 1;
+}
+
+uint64_t chip8_simd_run_frame(Chip8Simd* simd, int cycles_per_frame) {
+    // tick the timers and start every real lane, padding lanes stay stopped
+    // and so do lanes stuck on FX0A, whose wait is kept in their Chip8
+    for (int b = 0; b < simd->block_count; b++) {
+        Chip8SimdBlock* block = &simd->blocks[b];
+        block->delay_timer += MASK(block->delay_timer != 0);
+        block->sound_timer += MASK(block->sound_timer != 0);
+        for (int n = 0; n < WIDTH; n++) {
+            int lane = b * WIDTH + n;
+            block->stopped[n] = lane < simd->lanes && !chip8_key_blocked(&simd->machines[lane]) ? 0 : 0xFFFF;
+        }
+    }
+
+    uint64_t total = 0;
+    for (int left = cycles_per_frame; left > 0; left -= MAX_SLICE) {
+        int slice = left < MAX_SLICE ? left : MAX_SLICE;
+        for (int b = 0; b < simd->block_count; b++) {
+            simd->blocks[b].executed = (lanes_t){};
+            simd->blocks[b].live = ~simd->blocks[b].stopped;
+        }
+
+        while (step(simd, slice)) {
+        }
+
+        for (int b = 0; b < simd->block_count; b++) {
+            for (int n = 0; n < WIDTH; n++) {
+                total += simd->blocks[b].executed[n];
+            }
+        }
+    }
+    return total;
+}
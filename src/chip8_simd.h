@@ -0,0 +1,51 @@
+#ifndef CHIP8_SIMD_H
+#define CHIP8_SIMD_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// lockstep SIMD engine
+// runs many copies of one ROM with V, I, pc, the timers and the keys stored as
+// structure of arrays, 32 lanes per vector block
+// each step picks the lowest pc among the lanes still running, and every lane at
+// that pc executes the instruction together as one vector operation, the rest wait
+// draws, key waits and memory access run through chip8_step on each lane's
+// own Chip8, which also holds its memory, stack and display
+// built on the GCC/Clang vector extensions, so the width the blocks are split
+// into depends on the target (build with -march=native for AVX2 or AVX-512)
+
+typedef struct Chip8Simd Chip8Simd;
+
+// how well the lanes stayed together, summed over every step
+typedef struct Chip8SimdStats {
+    uint64_t steps;             // instructions issued, one per group of lanes
+    uint64_t vector_steps;      // steps run as vector operations
+    uint64_t scalar_steps;      // steps that went through chip8_step lane by lane
+    uint64_t divergent_steps;   // steps where some running lanes were at another pc
+    uint64_t lane_instructions; // instructions executed across all lanes
+    uint64_t live_lanes;        // lanes still running at each step
+} Chip8SimdStats;
+
+// lanes machines, all initialized with chip8_init
+Chip8Simd* chip8_simd_create(int lanes);
+void chip8_simd_destroy(Chip8Simd* simd);
+
+// load the same ROM into every lane, exits on failure like load_rom
+void chip8_simd_load_rom(Chip8Simd* simd, const char* filename);
+
+// seed the CXNN generator of lane i with seed + i
+// lanes start with the same seed, which keeps them together through CXNN
+void chip8_simd_seed(Chip8Simd* simd, uint64_t seed);
+
+// set the keypad bitmask of every lane, keys[i] goes to lane i
+void chip8_simd_set_keys(Chip8Simd* simd, const uint16_t* keys);
+
+// run every lane for one frame, same as chip8_run_frame on each
+// returns the instructions executed across all lanes
+uint64_t chip8_simd_run_frame(Chip8Simd* simd, int cycles_per_frame);
+
+// the state of one lane as a normal Chip8, valid until the next run
+Chip8* chip8_simd_machine(Chip8Simd* simd, int lane);
+
+void chip8_simd_stats(const Chip8Simd* simd, Chip8SimdStats* stats);
+
+#endif
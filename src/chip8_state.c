@@ -0,0 +1,136 @@
+#include "./chip8_state.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HEADER_SIZE offsetof(Chip8State, display)
+
+_Static_assert(sizeof(Chip8State) % 64 == 0, "Chip8State should be whole cache lines");
+_Static_assert(HEADER_SIZE == 16, "Chip8State header layout changed");
+_Static_assert(offsetof(Chip8State, memory_low) + CHIP8_STATE_LOW_SIZE + CHIP8_STATE_HIGH_SIZE
+    == sizeof(Chip8State), "Chip8State has padding");
+
+// Fletcher style sums over 64 bit words, four interleaved pairs so the adds don't
+// wait on each other, then mixed down to one word
+// the first sum of each pair catches changed words, the second moved ones
+// plain locals rather than arrays, which GCC keeps going through the stack
+static inline uint64_t load_word(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    return word;
+}
+
+static inline uint64_t mix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 32);
+}
+
+uint64_t chip8_state_checksum(const Chip8State* state) {
+    const uint8_t* body = (const uint8_t*)state + HEADER_SIZE;
+    size_t size = sizeof(Chip8State) - HEADER_SIZE;
+    uint64_t a0 = 1, a1 = 2, a2 = 3, a3 = 4;
+    uint64_t b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        a0 += load_word(body + i);
+        a1 += load_word(body + i + 8);
+        a2 += load_word(body + i + 16);
+        a3 += load_word(body + i + 24);
+        b0 += a0;
+        b1 += a1;
+        b2 += a2;
+        b3 += a3;
+    }
+    for (; i < size; i += 8) {
+        a0 += load_word(body + i);
+        b0 += a0;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = mix(hash, a0);
+    hash = mix(hash, a1);
+    hash = mix(hash, a2);
+    hash = mix(hash, a3);
+    hash = mix(hash, b0);
+    hash = mix(hash, b1);
+    hash = mix(hash, b2);
+    hash = mix(hash, b3);
+    return hash;
+}
+
+_Static_assert((sizeof(Chip8State) - HEADER_SIZE) % 8 == 0, "checksum expects whole words");
+
+_Static_assert(CHIP8_STATE_LOW_SIZE == CHIP8_FONT_START && CHIP8_STATE_HIGH_START == CHIP8_FONT_START + CHIP8_FONT_SIZE,
+    "a state leaves out exactly the font");
+
+// a state can't hold a font the ROM changed, chip8_load_font would undo it on load
+static int font_intact(const Chip8* chip8) {
+    return memcmp(&chip8->memory[CHIP8_FONT_START], chip8_font, CHIP8_FONT_SIZE) == 0;
+}
+
+int chip8_save_state(const Chip8* chip8, Chip8State* state) {
+    if (!font_intact(chip8)) {
+        return -1;
+    }
+
+    state->magic = CHIP8_STATE_MAGIC;
+    state->version = CHIP8_STATE_VERSION;
+    state->flags = 0;
+
+    memcpy(state->display, chip8->display, sizeof(state->display));
+    state->rng = chip8->rng;
+    memcpy(state->stack, chip8->stack, sizeof(state->stack));
+    state->pc = chip8->pc;
+    state->I = chip8->I;
+    state->keys = chip8->keys;
+    memcpy(state->V, chip8->V, sizeof(state->V));
+    state->top = chip8->top;
+    state->delay_timer = chip8->delay_timer;
+    state->sound_timer = chip8->sound_timer;
+    state->key_wait = chip8->key_wait;
+    state->key_wait_key = chip8->key_wait_key;
+    memset(state->reserved, 0, sizeof(state->reserved));
+
+    memcpy(state->memory_low, chip8->memory, CHIP8_STATE_LOW_SIZE);
+    memcpy(state->memory_high, &chip8->memory[CHIP8_STATE_HIGH_START], CHIP8_STATE_HIGH_SIZE);
+
+    state->checksum = chip8_state_checksum(state);
+    return 0;
+}
+
+Chip8StateError chip8_load_state(Chip8* chip8, const Chip8State* state) {
+    if (state->magic != CHIP8_STATE_MAGIC) {
+        return CHIP8_STATE_BAD_MAGIC;
+    }
+    if (state->version != CHIP8_STATE_VERSION) {
+        return CHIP8_STATE_BAD_VERSION;
+    }
+    if (state->checksum != chip8_state_checksum(state)) {
+        return CHIP8_STATE_BAD_CHECKSUM;
+    }
+
+    for (int y = 0; y < 32; y++) {
+        chip8->dirty_rows |= (uint32_t)(chip8->display[y] != state->display[y]) << y;
+    }
+    memcpy(chip8->display, state->display, sizeof(chip8->display));
+    chip8->rng = state->rng;
+    memcpy(chip8->stack, state->stack, sizeof(chip8->stack));
+    chip8->pc = state->pc;
+    chip8->I = state->I;
+    chip8->keys = state->keys;
+    memcpy(chip8->V, state->V, sizeof(chip8->V));
+    chip8->top = state->top;
+    chip8->delay_timer = state->delay_timer;
+    chip8->sound_timer = state->sound_timer;
+    chip8->key_wait = state->key_wait;
+    chip8->key_wait_key = state->key_wait_key & 0xF;
+
+    memcpy(chip8->memory, state->memory_low, CHIP8_STATE_LOW_SIZE);
+    chip8_load_font(chip8);
+    memcpy(&chip8->memory[CHIP8_STATE_HIGH_START], state->memory_high, CHIP8_STATE_HIGH_SIZE);
+
+    // whatever was predecoded belonged to the old memory
+    chip8_invalidate_code(chip8, 0, 4096);
+    return CHIP8_STATE_OK;
+}
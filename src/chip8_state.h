@@ -0,0 +1,69 @@
+#ifndef CHIP8_STATE_H
+#define CHIP8_STATE_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// savestates
+// a Chip8State is a fixed layout blob with no pointers, so an array of them can be
+// written to a file with one write and read back by mapping the file, with each
+// state loaded straight out of the mapping
+// the font at 0x050 - 0x09F is left out, chip8_load_font puts it back on load
+// fields are in host byte order, a state from a host with the other order fails the magic check
+
+#define CHIP8_STATE_MAGIC 0x54533843 // "C8ST" read as a little endian word
+#define CHIP8_STATE_VERSION 1
+
+// memory kept in a state, everything but the font
+#define CHIP8_STATE_LOW_SIZE 0x050
+#define CHIP8_STATE_HIGH_START 0x0A0
+#define CHIP8_STATE_HIGH_SIZE (4096 - CHIP8_STATE_HIGH_START)
+
+// every field is at its natural alignment and the size is a whole number of
+// cache lines, so there is no padding the compiler could lay out differently
+typedef struct Chip8State {
+    // header
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;    // 0, for later versions
+    uint64_t checksum; // of everything after the header
+
+    uint64_t display[32];
+    uint32_t rng;
+    uint16_t stack[16];
+    uint16_t pc;
+    uint16_t I;
+    uint16_t keys;
+    uint8_t V[16];
+    uint8_t top;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t key_wait;     // a Chip8KeyWait, 0 in states from before FX0A kept one
+    uint8_t key_wait_key;
+    uint8_t reserved[1]; // 0
+
+    uint8_t memory_low[CHIP8_STATE_LOW_SIZE];
+    uint8_t memory_high[CHIP8_STATE_HIGH_SIZE];
+} Chip8State;
+
+// results of chip8_load_state
+typedef enum Chip8StateError {
+    CHIP8_STATE_OK,
+    CHIP8_STATE_BAD_MAGIC,    // not a state, or written with the other byte order
+    CHIP8_STATE_BAD_VERSION,  // written by a newer version of the format
+    CHIP8_STATE_BAD_CHECKSUM, // corrupted
+} Chip8StateError;
+
+// fill in a state from a machine
+// fails only if the ROM has overwritten the font, which a state can't hold,
+// returns 0 on success and -1 then
+int chip8_save_state(const Chip8* chip8, Chip8State* state);
+
+// restore a machine from a state, leaving it untouched unless the state checks out
+// the predecode cache is invalidated, a jit's translations are the caller's to flush
+// rows of the display that differ from the state's are marked dirty
+Chip8StateError chip8_load_state(Chip8* chip8, const Chip8State* state);
+
+// checksum of the body of a state, what the header's checksum must match
+uint64_t chip8_state_checksum(const Chip8State* state);
+
+#endif
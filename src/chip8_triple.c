@@ -0,0 +1,69 @@
+#include "./chip8_triple.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// set in middle while the frame there hasn't been taken
+#define FRESH 4
+
+struct Chip8Triple {
+    _Alignas(64) Chip8Frame frames[3];
+
+    // the buffer between the two sides, with FRESH
+    _Alignas(64) atomic_uint middle;
+
+    // writer only
+    _Alignas(64) unsigned back;
+    uint64_t published;
+
+    // reader only
+    _Alignas(64) unsigned front;
+    uint64_t expected; // number of the frame right after the last one taken
+};
+
+Chip8Triple* chip8_triple_create(void) {
+    Chip8Triple* triple = aligned_alloc(64, sizeof(Chip8Triple));
+    if (triple == NULL) {
+        return NULL;
+    }
+    memset(triple->frames, 0, sizeof(triple->frames));
+    triple->back = 0;
+    triple->published = 0;
+    atomic_init(&triple->middle, 1);
+    triple->front = 2;
+    triple->expected = 0;
+    return triple;
+}
+
+void chip8_triple_destroy(Chip8Triple* triple) {
+    free(triple);
+}
+
+void chip8_triple_publish(Chip8Triple* triple, Chip8* chip8) {
+    Chip8Frame* frame = &triple->frames[triple->back];
+    memcpy(frame->display, chip8->display, sizeof(frame->display));
+    frame->dirty_rows = chip8_take_dirty_rows(chip8);
+    frame->number = triple->published++;
+
+    // release the frame, and take back whichever buffer was in the middle,
+    // the one the reader let go of or a frame it never got to
+    unsigned old = atomic_exchange_explicit(&triple->middle, triple->back | FRESH, memory_order_acq_rel);
+    triple->back = old & ~FRESH;
+}
+
+Chip8Frame* chip8_triple_take(Chip8Triple* triple) {
+    if (!(atomic_load_explicit(&triple->middle, memory_order_relaxed) & FRESH)) {
+        return NULL;
+    }
+    unsigned old = atomic_exchange_explicit(&triple->middle, triple->front, memory_order_acq_rel);
+    triple->front = old & ~FRESH;
+
+    // the dirty rows of dropped frames went with them
+    Chip8Frame* frame = &triple->frames[triple->front];
+    if (frame->number != triple->expected) {
+        frame->dirty_rows = 0xFFFFFFFF;
+    }
+    triple->expected = frame->number + 1;
+    return frame;
+}
@@ -0,0 +1,38 @@
+#ifndef CHIP8_TRIPLE_H
+#define CHIP8_TRIPLE_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// triple buffered display handoff
+// carries finished frames from the thread running a machine to the thread showing
+// it without either ever waiting on the other
+// of three buffers the writer fills one, the reader shows another and the third
+// holds the newest finished frame, swapped in and out with a single atomic exchange
+// a writer that publishes faster than the reader takes drops the frames in between,
+// the reader always gets the newest one
+
+// one finished frame
+typedef struct Chip8Frame {
+    uint64_t display[32];
+    // rows changed since the frame the reader took before this one,
+    // every row when frames were dropped in between
+    uint32_t dirty_rows;
+    // frames published before this one
+    uint64_t number;
+} Chip8Frame;
+
+typedef struct Chip8Triple Chip8Triple;
+
+Chip8Triple* chip8_triple_create(void);
+void chip8_triple_destroy(Chip8Triple* triple);
+
+// writer side
+// copy the machine's display out as the newest frame, taking its dirty rows
+void chip8_triple_publish(Chip8Triple* triple, Chip8* chip8);
+
+// reader side
+// the newest frame if one was published since the last call, NULL otherwise
+// the frame stays the reader's until the next call that doesn't return NULL
+Chip8Frame* chip8_triple_take(Chip8Triple* triple);
+
+#endif
@@ -0,0 +1,821 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "./chip8.h"
+#include "./chip8_jit.h"
+#include "./chip8_batch.h"
+#include "./chip8_pool.h"
+#include "./chip8_simd.h"
+#include "./chip8_state.h"
+#include "./chip8_rewind.h"
+#include "./chip8_movie.h"
+#include "./chip8_sched.h"
+
+// headless runner
+// runs ROMs with no window and no frame pacing, then reports instructions per second
+// used for throughput measurement and batch jobs on boxes without a display
+
+// bundled ROMs run when none are given on the command line
+static const char* default_roms[] = {
+    "ibm.ch8",
+    "3-corax.ch8",
+    "4-flags.ch8",
+    "5-quirks.ch8",
+};
+
+// instructions per 60hz timer tick, same as the interactive binary
+#define DEFAULT_CYCLES_PER_FRAME 10
+
+// jit for the ROM being run, only used by -m jit
+static Chip8Jit* jit;
+
+static Chip8Status run_jit(Chip8* chip8, int cycles, int* executed) {
+    return chip8_jit_run_cycles(jit, chip8, cycles, executed);
+}
+
+// dispatch modes that can be picked with -m
+static const struct {
+    const char* name;
+    Chip8RunFn run;
+} dispatch_modes[] = {
+    { "switch", chip8_run_cycles_switch },
+    { "table", chip8_run_cycles_table },
+    { "goto", chip8_run_cycles_goto },
+    { "cached", chip8_run_cycles_cached },
+    { "jit", run_jit },
+};
+
+// interpreter used for every run, the build default unless -m is given
+static Chip8RunFn run_fn = chip8_run_cycles;
+
+// CXNN seed from -r, batches give instance i seed + i
+// without -r every machine keeps the seed chip8_init gave it
+static int seeded;
+static uint64_t seed;
+
+// -i, skip idle loops, see chip8_skip_idle
+static int fast_forward;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-c cycles | -f frames] [-p cycles_per_frame] [-m mode] [-n instances [-l | -t threads | -T]] [-r seed] [-i] [-d] [-s | -S | -R | -M movie | -P movie] [rom_file ...]\n"
+        "  -c  run this many instructions per ROM uncapped (default 10000000)\n"
+        "  -f  run this many frames per ROM, stopping each frame on a draw\n"
+        "  -p  instructions per 60hz timer tick (default %d)\n"
+        "  -m  dispatch mode: switch, table, goto, cached or jit (default is the build's)\n"
+        "  -n  run this many instances of each ROM as a batch, -c is split between them\n"
+        "  -l  run the batch on the lockstep SIMD engine, whole frames only\n"
+        "  -t  run the batch on this many threads, 0 for one per core\n"
+        "  -T  run the batch on 1, 2, 4 ... threads up to one per core and report the scaling\n"
+        "  -r  seed the random number generators, instance i of a batch gets seed + i\n"
+        "  -i  fast forward through idle loops to the next timer tick and report what was skipped\n"
+        "  -d  dump the framebuffer of each ROM when it finishes\n"
+        "  -s  run the DXYN sprite microbenchmark instead of ROMs\n"
+        "  -S  run the savestate save and load benchmark on each ROM\n"
+        "  -R  run the rewind capture benchmark on each ROM, -f frames (default ten minutes)\n"
+        "  -M  record -f frames (default a minute) of scripted keys on the first ROM to a movie\n"
+        "  -P  play a movie back on the first ROM and print the final display and state hashes\n",
+        name, DEFAULT_CYCLES_PER_FRAME);
+}
+
+// run instructions flat out, ignoring the display wait quirk
+// timers still tick every cycles_per_frame cycles
+// returns the number of instructions executed
+static uint64_t run_cycles(Chip8* chip8, uint64_t cycles, int cycles_per_frame, int* blocked) {
+    Chip8Sched sched;
+    chip8_sched_init(&sched, cycles_per_frame);
+    sched.display_wait = 0;
+    sched.run = run_fn;
+    uint64_t total = chip8_sched_run(&sched, chip8, cycles);
+
+    // nothing will ever press a key here
+    *blocked = chip8_key_blocked(chip8);
+    return total;
+}
+
+// run whole frames the same way the interactive binary does, minus the pacing
+static uint64_t run_frames(Chip8* chip8, uint64_t frames, int cycles_per_frame, int* blocked) {
+    Chip8Sched sched;
+    chip8_sched_init(&sched, cycles_per_frame);
+    sched.run = run_fn;
+    uint64_t total = chip8_sched_run(&sched, chip8, frames * cycles_per_frame);
+
+    *blocked = chip8_key_blocked(chip8);
+    return total;
+}
+
+// run a batch of instances of one ROM, on the pool's threads if there is one
+// with -c the instructions are split evenly between the instances, with -f every
+// instance runs all the frames
+// returns the instructions executed across the batch
+static uint64_t run_batch(Chip8Batch* batch, Chip8Pool* pool, uint64_t cycles, uint64_t frames, int cycles_per_frame, int* blocked) {
+    int count = chip8_batch_count(batch);
+    uint64_t total = 0;
+
+    if (frames) {
+        for (uint64_t f = 0; f < frames; f++) {
+            total += pool
+                ? chip8_pool_run_frame(pool, cycles_per_frame)
+                : chip8_batch_run_frame(batch, cycles_per_frame);
+        }
+    }
+    else {
+        // in chunks so the per call budget fits in an int
+        uint64_t per_instance = cycles / count;
+        while (per_instance > 0) {
+            int chunk = per_instance > 100000000 ? 100000000 : (int)per_instance;
+            total += pool
+                ? chip8_pool_run_cycles(pool, chunk, cycles_per_frame)
+                : chip8_batch_run_cycles(batch, chunk, cycles_per_frame);
+            per_instance -= chunk;
+        }
+    }
+
+    *blocked = 0;
+    for (int i = 0; i < count; i++) {
+        *blocked += chip8_batch_result(batch, i)->status == CHIP8_KEY_WAIT;
+    }
+    return total;
+}
+
+// run instances of one ROM on the lockstep engine, frames only
+// with -c the instructions are turned into frames of cycles_per_frame per instance
+static uint64_t run_lockstep(Chip8Simd* simd, int count, uint64_t cycles, uint64_t frames, int cycles_per_frame) {
+    if (frames == 0) {
+        frames = cycles / ((uint64_t)count * cycles_per_frame);
+    }
+
+    uint64_t total = 0;
+    for (uint64_t f = 0; f < frames; f++) {
+        total += chip8_simd_run_frame(simd, cycles_per_frame);
+    }
+    return total;
+}
+
+// run every ROM as a batch on 1, 2, 4 ... threads, and on one per core,
+// and report the aggregate throughput of each against a single thread
+static int sweep_threads(const char** roms, int rom_count, int instances, uint64_t cycles, uint64_t frames, int cycles_per_frame) {
+    int cores = chip8_pool_cores();
+    double base = 0;
+
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+
+        uint64_t grand_total = 0;
+        double grand_time = 0;
+        uint64_t steals = 0;
+        uint64_t chunks = 0;
+
+        for (int r = 0; r < rom_count; r++) {
+            Chip8Batch* batch = chip8_batch_create(instances, run_fn);
+            if (batch == NULL) {
+                fprintf(stderr, "failed to allocate %d instances\n", instances);
+                return 1;
+            }
+            Chip8Pool* pool = chip8_pool_create(batch, threads, 0);
+            if (pool == NULL) {
+                fprintf(stderr, "failed to allocate the thread pool\n");
+                chip8_batch_destroy(batch);
+                return 1;
+            }
+            chip8_batch_load_rom(batch, roms[r]);
+            if (seeded) {
+                chip8_batch_seed(batch, seed);
+            }
+
+            int blocked;
+            double start = now_seconds();
+            grand_total += run_batch(batch, pool, cycles, frames, cycles_per_frame, &blocked);
+            grand_time += now_seconds() - start;
+
+            Chip8PoolStats stats;
+            chip8_pool_stats(pool, &stats);
+            steals += stats.steals;
+            chunks += stats.chunks;
+
+            chip8_pool_destroy(pool);
+            chip8_batch_destroy(batch);
+        }
+
+        double mips = grand_time > 0 ? grand_total / grand_time / 1e6 : 0.0;
+        if (threads == 1) {
+            base = mips;
+        }
+        printf("%3d threads %14llu instructions %9.4f s %10.2f MIPS  x%.2f  %5.1f%% stolen\n",
+            threads, (unsigned long long)grand_total, grand_time, mips,
+            base > 0 ? mips / base : 0.0,
+            chunks ? 100.0 * steals / chunks : 0.0);
+
+        if (threads == cores) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// scripted input for the benchmarks and -M, a new key mask every half second
+static uint16_t scripted_keys(uint64_t frame) {
+    uint32_t x = (uint32_t)(frame / 30) * 2654435761u;
+    return (uint16_t)(x >> 16) & (uint16_t)(x >> 8);
+}
+
+// hash of everything a savestate holds, 0 if the machine can't be saved
+static uint64_t state_hash(const Chip8* chip8) {
+    static Chip8State state;
+    return chip8_save_state(chip8, &state) == 0 ? state.checksum : 0;
+}
+
+// savestate benchmark sizes, the ring is bigger than the last level cache
+// so the numbers include the memory traffic of a real dataset
+#define STATE_BENCH_COUNT (1 << 18)
+#define STATE_BENCH_RING 4096
+
+// savestate benchmark
+// runs each ROM for a few seconds of frames to get a realistic state, times saving
+// it over and over into a ring of states and loading them back, then writes the
+// ring to a file with one write, maps it and loads every state from the mapping
+static int bench_states(const char** roms, int rom_count, int cycles_per_frame) {
+    Chip8State* ring = aligned_alloc(64, STATE_BENCH_RING * sizeof(Chip8State));
+    if (ring == NULL) {
+        fprintf(stderr, "failed to allocate %d states\n", STATE_BENCH_RING);
+        return 1;
+    }
+
+    for (int r = 0; r < rom_count; r++) {
+        Chip8 chip8;
+        chip8_init(&chip8);
+        load_rom(&chip8, roms[r]);
+        if (seeded) {
+            chip8_seed(&chip8, seed);
+        }
+        for (int f = 0; f < 300; f++) {
+            chip8_run_frame(&chip8, cycles_per_frame);
+        }
+
+        double start = now_seconds();
+        for (int i = 0; i < STATE_BENCH_COUNT; i++) {
+            if (chip8_save_state(&chip8, &ring[i % STATE_BENCH_RING]) != 0) {
+                fprintf(stderr, "%s: the ROM overwrote the font, it can't be saved\n", roms[r]);
+                free(ring);
+                return 1;
+            }
+        }
+        double save_time = now_seconds() - start;
+
+        Chip8 loaded;
+        chip8_init(&loaded);
+        start = now_seconds();
+        for (int i = 0; i < STATE_BENCH_COUNT; i++) {
+            if (chip8_load_state(&loaded, &ring[i % STATE_BENCH_RING]) != CHIP8_STATE_OK) {
+                fprintf(stderr, "%s: state %d failed to load\n", roms[r], i);
+                free(ring);
+                return 1;
+            }
+        }
+        double load_time = now_seconds() - start;
+
+        // the round trip through a file, loading straight from the mapped pages
+        size_t size = STATE_BENCH_RING * sizeof(Chip8State);
+        FILE* file = tmpfile();
+        int mapped_ok = 0;
+        if (file != NULL && write(fileno(file), ring, size) == (ssize_t)size) {
+            const Chip8State* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+            if (mapped != MAP_FAILED) {
+                mapped_ok = 1;
+                // a load only fills in what a state holds, so it goes into the
+                // machine initialized above rather than a fresh one each time
+                for (int i = 0; i < STATE_BENCH_RING; i++) {
+                    mapped_ok &= chip8_load_state(&loaded, &mapped[i]) == CHIP8_STATE_OK
+                        && chip8_display_hash(&loaded) == chip8_display_hash(&chip8)
+                        && memcmp(loaded.memory, chip8.memory, sizeof(loaded.memory)) == 0;
+                }
+                munmap((void*)mapped, size);
+            }
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+
+        printf("%-16s %12d states %8.4f s save %10.0f/s %8.4f s load %10.0f/s  %d bytes  file %s\n",
+            roms[r], STATE_BENCH_COUNT,
+            save_time, save_time > 0 ? STATE_BENCH_COUNT / save_time : 0.0,
+            load_time, load_time > 0 ? STATE_BENCH_COUNT / load_time : 0.0,
+            (int)sizeof(Chip8State), mapped_ok ? "ok" : "FAILED");
+    }
+
+    free(ring);
+    return 0;
+}
+
+// rewind benchmark ring, the same size the interactive binary uses
+#define REWIND_BENCH_BYTES (8 << 20)
+
+// rewind benchmark
+// plays each ROM with keys changing every half second, capturing every frame,
+// then steps back through the whole history checking each frame comes back
+// exactly as it was played
+static int bench_rewind(const char** roms, int rom_count, uint64_t frames, int cycles_per_frame) {
+    if (frames == 0) {
+        frames = 60 * 60 * 10; // ten minutes
+    }
+    Chip8Rewind* history = chip8_rewind_create(REWIND_BENCH_BYTES);
+    uint64_t* hashes = malloc(frames * sizeof(uint64_t));
+    if (history == NULL || hashes == NULL) {
+        fprintf(stderr, "failed to allocate the rewind buffer\n");
+        return 1;
+    }
+
+    for (int r = 0; r < rom_count; r++) {
+        Chip8 chip8;
+        chip8_init(&chip8);
+        load_rom(&chip8, roms[r]);
+        if (seeded) {
+            chip8_seed(&chip8, seed);
+        }
+        chip8_rewind_clear(history);
+
+        double capture_time = 0;
+        uint64_t captured = 0;
+        for (uint64_t f = 0; f < frames; f++) {
+            chip8.keys = scripted_keys(f);
+            chip8_run_frame(&chip8, cycles_per_frame);
+
+            double start = now_seconds();
+            int failed = chip8_rewind_capture(history, &chip8);
+            capture_time += now_seconds() - start;
+            if (failed) {
+                fprintf(stderr, "%s: the ROM overwrote the font, it can't be rewound\n", roms[r]);
+                break;
+            }
+            hashes[f] = chip8_display_hash(&chip8) ^ chip8.pc ^ (uint64_t)chip8.rng << 16;
+            captured++;
+        }
+        if (captured == 0) {
+            continue;
+        }
+
+        // bytes per frame while the ring still held everything, if it ever did
+        int kept = chip8_rewind_frames(history);
+        size_t used = chip8_rewind_used(history);
+        double per_frame = kept ? (double)used / kept : 0.0;
+
+        int matched = 0;
+        double start = now_seconds();
+        for (int k = 0; k < kept; k++) {
+            chip8_rewind_step_back(history, &chip8);
+            uint64_t f = captured - 2 - k;
+            matched += hashes[f] == (chip8_display_hash(&chip8) ^ chip8.pc ^ (uint64_t)chip8.rng << 16);
+        }
+        double back_time = now_seconds() - start;
+
+        printf("%-16s %8llu frames %7.0f ns/capture %7.0f ns/step back %7.1f bytes/frame %6.2f MB/hour  %d of %d back %s\n",
+            roms[r], (unsigned long long)captured,
+            capture_time * 1e9 / captured, kept ? back_time * 1e9 / kept : 0.0,
+            per_frame, per_frame * 60 * 60 * 60 / 1e6,
+            kept, (int)captured - 1, matched == kept ? "ok" : "MISMATCH");
+    }
+
+    free(hashes);
+    chip8_rewind_destroy(history);
+    return 0;
+}
+
+// record the scripted keys over frames of the ROM into a movie file
+static int record_movie(const char* filename, const char* rom, uint64_t frames, int cycles_per_frame) {
+    Chip8 chip8;
+    chip8_init(&chip8);
+    load_rom(&chip8, rom);
+    if (seeded) {
+        chip8_seed(&chip8, seed);
+    }
+    Chip8Movie* movie = chip8_movie_create(&chip8, cycles_per_frame);
+    if (movie == NULL) {
+        fprintf(stderr, "failed to allocate the movie\n");
+        return 1;
+    }
+
+    Chip8Sched sched;
+    chip8_sched_init(&sched, cycles_per_frame);
+    for (uint64_t f = 0; f < frames; f++) {
+        chip8.keys = scripted_keys(f);
+        chip8_movie_record(movie, (uint32_t)f, chip8.keys);
+        chip8_sched_run(&sched, &chip8, cycles_per_frame);
+    }
+    chip8_movie_set_frames(movie, (uint32_t)frames);
+
+    int failed = chip8_movie_save(movie, filename) != 0;
+    if (failed) {
+        fprintf(stderr, "failed to save movie: %s\n", filename);
+    }
+    else {
+        printf("%-16s %8llu frames recorded to %s  display %016llx  state %016llx\n",
+            rom, (unsigned long long)frames, filename,
+            (unsigned long long)chip8_display_hash(&chip8), (unsigned long long)state_hash(&chip8));
+    }
+    chip8_movie_destroy(movie);
+    return failed;
+}
+
+// play a movie back on the ROM it was recorded on, flat out with the -m interpreter
+// the final hashes are the same on every build and every dispatch mode
+static int play_movie(const char* filename, const char* rom) {
+    Chip8Movie* movie = chip8_movie_load(filename);
+    if (movie == NULL) {
+        fprintf(stderr, "failed to load movie: %s\n", filename);
+        return 1;
+    }
+
+    Chip8 chip8;
+    chip8_init(&chip8);
+    load_rom(&chip8, rom);
+    if (chip8_movie_start(movie, &chip8) != 0) {
+        fprintf(stderr, "%s wasn't recorded on %s\n", filename, rom);
+        chip8_movie_destroy(movie);
+        return 1;
+    }
+    chip8.fast_forward = fast_forward;
+    if (run_fn == chip8_run_cycles_cached) {
+        chip8_enable_predecode(&chip8);
+    }
+    if (run_fn == run_jit) {
+        jit = chip8_jit_create();
+        if (jit == NULL) {
+            fprintf(stderr, "failed to allocate the jit\n");
+            chip8_movie_destroy(movie);
+            return 1;
+        }
+    }
+
+    uint32_t frames = chip8_movie_frames(movie);
+    int cycles_per_frame = chip8_movie_cycles_per_frame(movie);
+    Chip8Sched sched;
+    chip8_sched_init(&sched, cycles_per_frame);
+    sched.run = run_fn;
+
+    uint64_t total = 0;
+    double start = now_seconds();
+    for (uint32_t f = 0; f < frames; f++) {
+        chip8.keys = chip8_movie_keys(movie, f);
+        total += chip8_sched_run(&sched, &chip8, cycles_per_frame);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-16s %8u frames %12llu instructions %9.4f s %10.2f MIPS  display %016llx  state %016llx\n",
+        rom, frames, (unsigned long long)total, elapsed,
+        elapsed > 0 ? total / elapsed / 1e6 : 0.0,
+        (unsigned long long)chip8_display_hash(&chip8), (unsigned long long)state_hash(&chip8));
+
+    chip8_disable_predecode(&chip8);
+    chip8_jit_destroy(jit);
+    jit = NULL;
+    chip8_movie_destroy(movie);
+    return 0;
+}
+
+// sprite microbenchmark
+// a tight loop that walks a 15 row sprite across the screen, including the
+// clipped right and bottom edges, so nearly all of the time is spent in DXYN
+static int bench_sprites(uint64_t cycles) {
+    static const uint16_t program[] = {
+        0xA300, // I = 0x300
+        0x7003, // V0 += 3
+        0x7105, // V1 += 5
+        0xD01F, // draw 15 rows at (V0, V1)
+        0x1202, // loop back to V0 += 3
+    };
+
+    Chip8 chip8;
+    chip8_init(&chip8);
+    if (run_fn == run_jit) {
+        jit = chip8_jit_create();
+        if (jit == NULL) {
+            fprintf(stderr, "failed to allocate the jit\n");
+            return 1;
+        }
+    }
+    for (unsigned i = 0; i < sizeof(program) / sizeof(program[0]); i++) {
+        chip8.memory[0x200 + i * 2] = program[i] >> 8;
+        chip8.memory[0x200 + i * 2 + 1] = program[i] & 0xFF;
+    }
+    for (int i = 0; i < 15; i++) {
+        chip8.memory[0x300 + i] = 0xA5 ^ (i * 0x1F);
+    }
+
+    uint64_t total = 0;
+    double start = now_seconds();
+    while (total < cycles) {
+        int executed;
+        run_fn(&chip8, 1000, &executed);
+        total += executed;
+    }
+    double elapsed = now_seconds() - start;
+
+    // one instruction in four is a draw
+    uint64_t sprites = total / 4;
+    printf("%-16s %12llu sprites      %9.4f s %10.2f ns/sprite  display %016llx\n",
+        "DXYN bench", (unsigned long long)sprites, elapsed,
+        sprites ? elapsed * 1e9 / sprites : 0.0,
+        (unsigned long long)chip8_display_hash(&chip8));
+
+    chip8_jit_destroy(jit);
+    jit = NULL;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t cycles = 10000000;
+    uint64_t frames = 0;
+    int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+    int dump = 0;
+    int sprites = 0;
+    int states = 0;
+    int rewinds = 0;
+    const char* record_file = NULL;
+    const char* play_file = NULL;
+    int instances = 0;
+    int lockstep = 0;
+    int threads = -1;
+    int sweep = 0;
+
+    // parse options, everything after them is a ROM
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-d") == 0) {
+            dump = 1;
+        }
+        else if (strcmp(argv[arg], "-l") == 0) {
+            lockstep = 1;
+        }
+        else if (strcmp(argv[arg], "-T") == 0) {
+            sweep = 1;
+        }
+        else if (strcmp(argv[arg], "-i") == 0) {
+            fast_forward = 1;
+        }
+        else if (strcmp(argv[arg], "-s") == 0) {
+            sprites = 1;
+        }
+        else if (strcmp(argv[arg], "-S") == 0) {
+            states = 1;
+        }
+        else if (strcmp(argv[arg], "-R") == 0) {
+            rewinds = 1;
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-c") == 0) {
+            cycles = strtoull(argv[++arg], NULL, 10);
+            frames = 0;
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-f") == 0) {
+            frames = strtoull(argv[++arg], NULL, 10);
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-m") == 0) {
+            const char* name = argv[++arg];
+            run_fn = NULL;
+            for (unsigned m = 0; m < sizeof(dispatch_modes) / sizeof(dispatch_modes[0]); m++) {
+                if (strcmp(name, dispatch_modes[m].name) == 0) {
+                    run_fn = dispatch_modes[m].run;
+                }
+            }
+            if (!run_fn) {
+                fprintf(stderr, "unknown dispatch mode: %s\n", name);
+                return 1;
+            }
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-n") == 0) {
+            instances = atoi(argv[++arg]);
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+            threads = atoi(argv[++arg]);
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-r") == 0) {
+            seed = strtoull(argv[++arg], NULL, 10);
+            seeded = 1;
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-M") == 0) {
+            record_file = argv[++arg];
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-P") == 0) {
+            play_file = argv[++arg];
+        }
+        else if (arg + 1 < argc && strcmp(argv[arg], "-p") == 0) {
+            cycles_per_frame = atoi(argv[++arg]);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int batch_only = lockstep || threads >= 0 || sweep;
+    if (cycles_per_frame <= 0 || instances < 0 || (batch_only && instances == 0)
+        || lockstep + (threads >= 0) + sweep > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // the jit keeps one translation cache, so it can't drive a batch
+    if (instances > 0 && run_fn == run_jit) {
+        fprintf(stderr, "-m jit can't be used with -n\n");
+        return 1;
+    }
+
+    if (sprites) {
+        return bench_sprites(cycles);
+    }
+
+    const char** roms = (const char**)&argv[arg];
+    int rom_count = argc - arg;
+    if (rom_count == 0) {
+        roms = default_roms;
+        rom_count = sizeof(default_roms) / sizeof(default_roms[0]);
+    }
+
+    if (record_file) {
+        return record_movie(record_file, roms[0], frames ? frames : 60 * 60, cycles_per_frame);
+    }
+    if (play_file) {
+        return play_movie(play_file, roms[0]);
+    }
+
+    if (states) {
+        return bench_states(roms, rom_count, cycles_per_frame);
+    }
+    if (rewinds) {
+        return bench_rewind(roms, rom_count, frames, cycles_per_frame);
+    }
+
+    if (sweep) {
+        return sweep_threads(roms, rom_count, instances, cycles, frames, cycles_per_frame);
+    }
+
+    uint64_t grand_total = 0;
+    double grand_time = 0;
+
+    for (int r = 0; r < rom_count; r++) {
+        if (lockstep) {
+            Chip8Simd* simd = chip8_simd_create(instances);
+            if (simd == NULL) {
+                fprintf(stderr, "failed to allocate %d lanes\n", instances);
+                return 1;
+            }
+            chip8_simd_load_rom(simd, roms[r]);
+            if (seeded) {
+                chip8_simd_seed(simd, seed);
+            }
+
+            double start = now_seconds();
+            uint64_t total = run_lockstep(simd, instances, cycles, frames, cycles_per_frame);
+            double elapsed = now_seconds() - start;
+
+            grand_total += total;
+            grand_time += elapsed;
+
+            Chip8SimdStats stats;
+            chip8_simd_stats(simd, &stats);
+            Chip8* first = chip8_simd_machine(simd, 0);
+            printf("%-16s %12llu instructions %9.4f s %10.2f MIPS  display %016llx  x%d\n",
+                roms[r], (unsigned long long)total, elapsed,
+                elapsed > 0 ? total / elapsed / 1e6 : 0.0,
+                (unsigned long long)chip8_display_hash(first), instances);
+
+            // utilisation is lanes doing work per step out of all lanes,
+            // coherence the same out of the lanes that could have
+            uint64_t steps = stats.steps ? stats.steps : 1;
+            printf("%-16s %12llu steps        %5.1f%% vector  %5.1f%% divergent  utilisation %5.1f%%  coherence %5.1f%%\n",
+                "", (unsigned long long)stats.steps,
+                100.0 * stats.vector_steps / steps,
+                100.0 * stats.divergent_steps / steps,
+                100.0 * stats.lane_instructions / ((double)steps * instances),
+                stats.live_lanes ? 100.0 * stats.lane_instructions / stats.live_lanes : 0.0);
+
+            if (dump) {
+                print_display(first);
+            }
+            chip8_simd_destroy(simd);
+            continue;
+        }
+
+        if (instances > 0) {
+            Chip8Batch* batch = chip8_batch_create(instances, run_fn);
+            if (batch == NULL) {
+                fprintf(stderr, "failed to allocate %d instances\n", instances);
+                return 1;
+            }
+            chip8_batch_load_rom(batch, roms[r]);
+            if (seeded) {
+                chip8_batch_seed(batch, seed);
+            }
+            chip8_batch_set_fast_forward(batch, fast_forward);
+
+            Chip8Pool* pool = NULL;
+            if (threads >= 0) {
+                pool = chip8_pool_create(batch, threads, 0);
+                if (pool == NULL) {
+                    fprintf(stderr, "failed to allocate the thread pool\n");
+                    chip8_batch_destroy(batch);
+                    return 1;
+                }
+            }
+
+            int blocked;
+            double start = now_seconds();
+            uint64_t total = run_batch(batch, pool, cycles, frames, cycles_per_frame, &blocked);
+            double elapsed = now_seconds() - start;
+
+            grand_total += total;
+            grand_time += elapsed;
+
+            // every instance starts the same, so the first one stands in for the rest
+            Chip8* first = chip8_batch_machine(batch, 0);
+            printf("%-16s %12llu instructions %9.4f s %10.2f MIPS  display %016llx  x%d",
+                roms[r], (unsigned long long)total, elapsed,
+                elapsed > 0 ? total / elapsed / 1e6 : 0.0,
+                (unsigned long long)chip8_display_hash(first), instances);
+            if (blocked) {
+                printf("  (%d blocked on FX0A)", blocked);
+            }
+            if (fast_forward) {
+                printf("  %llu skipped", (unsigned long long)chip8_batch_skipped_cycles(batch));
+            }
+            if (pool) {
+                Chip8PoolStats stats;
+                chip8_pool_stats(pool, &stats);
+                printf("  %d threads, %llu of %llu chunks stolen", chip8_pool_threads(pool),
+                    (unsigned long long)stats.steals, (unsigned long long)stats.chunks);
+            }
+            printf("\n");
+
+            if (dump) {
+                print_display(first);
+            }
+            chip8_pool_destroy(pool);
+            chip8_batch_destroy(batch);
+            continue;
+        }
+
+        // initialize Chip8 and load the rom
+        Chip8 chip8;
+        chip8_init(&chip8);
+        load_rom(&chip8, roms[r]);
+        if (seeded) {
+            chip8_seed(&chip8, seed);
+        }
+        chip8.fast_forward = fast_forward;
+        if (run_fn == chip8_run_cycles_cached) {
+            chip8_enable_predecode(&chip8);
+        }
+        if (run_fn == run_jit) {
+            jit = chip8_jit_create();
+            if (jit == NULL) {
+                fprintf(stderr, "failed to allocate the jit\n");
+                return 1;
+            }
+        }
+
+        int blocked = 0;
+        double start = now_seconds();
+        uint64_t total = frames
+            ? run_frames(&chip8, frames, cycles_per_frame, &blocked)
+            : run_cycles(&chip8, cycles, cycles_per_frame, &blocked);
+        double elapsed = now_seconds() - start;
+
+        grand_total += total;
+        grand_time += elapsed;
+
+        printf("%-16s %12llu instructions %9.4f s %10.2f MIPS  display %016llx%s",
+            roms[r], (unsigned long long)total, elapsed,
+            elapsed > 0 ? total / elapsed / 1e6 : 0.0,
+            (unsigned long long)chip8_display_hash(&chip8),
+            blocked ? "  (blocked on FX0A)" : "");
+        if (fast_forward) {
+            printf("  %llu skipped", (unsigned long long)chip8.skipped_cycles);
+        }
+        printf("\n");
+
+        if (dump) {
+            print_display(&chip8);
+        }
+        chip8_disable_predecode(&chip8);
+        chip8_jit_destroy(jit);
+        jit = NULL;
+    }
+
+    printf("%-16s %12llu instructions %9.4f s %10.2f MIPS\n",
+        "total", (unsigned long long)grand_total, grand_time,
+        grand_time > 0 ? grand_total / grand_time / 1e6 : 0.0);
+
+    return 0;
+}
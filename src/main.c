@@ -1,60 +1,353 @@
 #include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "./chip8.h"
+#include "./chip8_rewind.h"
+#include "./chip8_movie.h"
+#include "./chip8_input.h"
+#include "./chip8_sched.h"
+#include "./chip8_render.h"
+#include "./chip8_triple.h"
+#include "./chip8_pace.h"
+#include "./chip8_governor.h"
 
 // openGL
 #include <GL/gl.h>
 #include "./glfw3.h"
 
-// these allow us to grab the instructions from each fetch
-// can pull out each nibble from opcode
-#define FETCH_OPCODE() (chip8.memory[chip8.pc] << 8 | chip8.memory[chip8.pc + 1])
-#define EXTRACT_X(opcode) ((opcode & 0x0F00) >> 8)
-#define EXTRACT_Y(opcode) ((opcode & 0x00F0) >> 4)
-#define EXTRACT_N(opcode) (opcode & 0x000F)
-#define EXTRACT_NN(opcode) (opcode & 0x00FF)
-#define EXTRACT_NNN(opcode) (opcode & 0x0FFF)
-
-// define key array
-uint8_t keys[16] = {0};
+// 600 instructions per second unless -s says otherwise
+#define DEFAULT_IPS 600
+
+// rewind ring size, a few megabytes holds about an hour of typical play
+#define REWIND_BYTES (8 << 20)
+// frames run per 60hz frame while tab is held, unless already unlimited
+#define TURBO_FRAMES 8
+// the last half millisecond before each frame is spun rather than slept,
+// which keeps nearly every frame start within 10us of its deadline for a few
+// percent of a core
+#define PACE_SPIN_NS 500000
+
+// the machine and everything driving it, run on the emulation thread
+// the window thread only touches the input queue, the flags and the triple buffer
+typedef struct Emulation {
+    Chip8 chip8;
+    Chip8Sched sched;
+    // cycles each frame gets
+    Chip8Governor governor;
+    // frames run so far, the index movies go by
+    uint32_t frame;
+
+    Chip8Input* input;
+    // window thread only, the keypad as held and as queued so far, they differ
+    // while the ring is full and catch up once it has room
+    uint16_t keys_held;
+    uint16_t keys_queued;
+    Chip8Rewind* history;
+    Chip8Movie* movie;
+    int recording;
+    int playing;
+
+    // finished frames on their way to the window
+    Chip8Triple* frames;
+
+    // set by the window thread
+    atomic_int running;
+    atomic_int rewinding; // backspace held
+    atomic_int turbo;     // tab held
+
+    // frame deadlines and how close to them frames started
+    Chip8Pace pace;
+} Emulation;
+
+// queue every key whose state the emulation thread hasn't been sent yet
+// stops at the first that doesn't fit, the rest wait for the next try
+// returns 1 if anything is still waiting
+static int send_keys(Emulation* emu) {
+    uint16_t changed = emu->keys_held ^ emu->keys_queued;
+    while (changed) {
+        int k = __builtin_ctz(changed);
+        int pressed = (emu->keys_held >> k) & 1;
+        if (chip8_input_press(emu->input, k, pressed) != 0) {
+            return 1;
+        }
+        emu->keys_queued ^= 1 << k;
+        changed &= changed - 1;
+    }
+    return 0;
+}
 
 // call back function for key presses
-void key_callback(GLFWwindow* window, int key, int scancode, int action) {
+// maps the keyboard onto the 4x4 keypad and queues the change on the input queue,
+// the emulation thread applies it between instructions
+// a change that finds the queue full isn't lost, send_keys queues it once there's room
+// backspace and tab set the flags the emulation thread rewinds and speeds up by
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    (void)scancode;
+    (void)mods;
+    Emulation* emu = glfwGetWindowUserPointer(window);
+    int k;
+
     if (action == GLFW_PRESS || action == GLFW_RELEASE) {
+        if (key == GLFW_KEY_BACKSPACE) {
+            atomic_store_explicit(&emu->rewinding, action == GLFW_PRESS, memory_order_relaxed);
+            return;
+        }
+        if (key == GLFW_KEY_TAB) {
+            atomic_store_explicit(&emu->turbo, action == GLFW_PRESS, memory_order_relaxed);
+            return;
+        }
+        // a movie being played back is the only input
+        if (emu->playing) {
+            return;
+        }
+
         switch (key) {
-            case GLFW_KEY_1: keys[0x1] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_2: keys[0x2] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_3: keys[0x3] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_4: keys[0xC] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_Q: keys[0x4] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_W: keys[0x5] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_E: keys[0x6] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_R: keys[0xD] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_A: keys[0x7] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_S: keys[0x8] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_D: keys[0x9] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_F: keys[0xE] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_Z: keys[0xA] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_X: keys[0x0] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_C: keys[0xB] = action == GLFW_PRESS ? 1 : 0; break;
-            case GLFW_KEY_V: keys[0xF] = action == GLFW_PRESS ? 1 : 0; break;
+            case GLFW_KEY_1: k = 0x1; break;
+            case GLFW_KEY_2: k = 0x2; break;
+            case GLFW_KEY_3: k = 0x3; break;
+            case GLFW_KEY_4: k = 0xC; break;
+            case GLFW_KEY_Q: k = 0x4; break;
+            case GLFW_KEY_W: k = 0x5; break;
+            case GLFW_KEY_E: k = 0x6; break;
+            case GLFW_KEY_R: k = 0xD; break;
+            case GLFW_KEY_A: k = 0x7; break;
+            case GLFW_KEY_S: k = 0x8; break;
+            case GLFW_KEY_D: k = 0x9; break;
+            case GLFW_KEY_F: k = 0xE; break;
+            case GLFW_KEY_Z: k = 0xA; break;
+            case GLFW_KEY_X: k = 0x0; break;
+            case GLFW_KEY_C: k = 0xB; break;
+            case GLFW_KEY_V: k = 0xF; break;
+            default: return;
         }
+
+        if (action == GLFW_PRESS) {
+            emu->keys_held |= 1 << k;
+        }
+        else {
+            emu->keys_held &= ~(1 << k);
+        }
+        send_keys(emu);
     }
 }
 
+// set when the window system needs the window drawn again, e.g. after it was uncovered
+static int window_damaged = 1;
+
+void refresh_callback(GLFWwindow* window) {
+    (void)window;
+    window_damaged = 1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// run one 60hz frame, or step one back while backspace is held
+static void emulate_frame(Emulation* emu) {
+    Chip8* chip8 = &emu->chip8;
+
+    if (atomic_load_explicit(&emu->rewinding, memory_order_relaxed)) {
+        // one frame back per frame, the keys held now stay held
+        uint16_t keys = chip8->keys;
+        if (chip8_rewind_step_back(emu->history, chip8) == 0) {
+            emu->frame--;
+            // the clock keeps going forward, so keys already queued still land on time
+            chip8_sched_seek(&emu->sched, emu->sched.clock);
+            // a recording carries on from the frame rewound to
+            if (emu->recording) {
+                chip8_movie_truncate(emu->movie, emu->frame);
+            }
+        }
+        chip8->keys = keys;
+        return;
+    }
+
+    // holding tab runs several frames of emulated time in one,
+    // the scheduler ticks the timers for each of them all the same
+    int frames = 1;
+    if (atomic_load_explicit(&emu->turbo, memory_order_relaxed) && emu->governor.ips != CHIP8_IPS_UNLIMITED) {
+        frames = TURBO_FRAMES;
+    }
+    for (int f = 0; f < frames; f++) {
+        // keys pressed since the last frame land now, live the rest land at their
+        // stamps, while recording they all wait for the next frame boundary
+        chip8_input_set_clock(emu->input, emu->sched.clock);
+        chip8_input_apply(emu->input, chip8);
+        if (emu->playing && emu->frame < chip8_movie_frames(emu->movie)) {
+            chip8->keys = chip8_movie_keys(emu->movie, emu->frame);
+        }
+        if (emu->recording) {
+            chip8_movie_record(emu->movie, emu->frame, chip8->keys);
+        }
+
+        // one tick of emulated time, as long as the governor says, the scheduler
+        // stalls the rest of it after a draw and while FX0A waits
+        // every frame starts on a tick, so the tick is simply the frame's length
+        int budget = chip8_governor_next(&emu->governor);
+        emu->sched.cycles_per_tick = budget;
+        double start = now_seconds();
+        uint64_t executed = chip8_sched_run(&emu->sched, chip8, budget);
+        chip8_governor_done(&emu->governor, executed, now_seconds() - start);
+        chip8_rewind_capture(emu->history, chip8);
+        emu->frame++;
+    }
+}
+
+// emulation thread
+// runs frames at 60hz and hands the ones that changed the display to the window
+// thread, it never waits on the window, the GPU or the driver
+static void* emulate(void* arg) {
+    Emulation* emu = arg;
+
+    chip8_pace_init(&emu->pace, 60, PACE_SPIN_NS);
+    while (atomic_load_explicit(&emu->running, memory_order_relaxed)) {
+        // frame n starts at n / 60 seconds from the first, however long the last one took
+        chip8_pace_wait(&emu->pace);
+
+        emulate_frame(emu);
+        if (chip8_display_changed(&emu->chip8)) {
+            chip8_triple_publish(emu->frames, &emu->chip8);
+            // wake the window thread to show it
+            glfwPostEmptyEvent();
+        }
+    }
+    return NULL;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <rom_file>\n", argv[0]);
+    // -r records the keys into a movie file, -p plays one back instead of the keyboard
+    // -s sets the instructions per second, max for as many as one core can run
+    // -w turns off the display wait quirk, for ROMs written for faster interpreters
+    // -t prints frame pacing and instruction rate stats to stderr on exit
+    const char* record_file = NULL;
+    const char* play_file = NULL;
+    uint64_t ips = DEFAULT_IPS;
+    int ips_set = 0;
+    int display_wait = 1;
+    int print_timing = 0;
+    int arg = 1;
+    for (; arg < argc - 1; arg++) {
+        if (arg + 1 < argc - 1 && strcmp(argv[arg], "-r") == 0) {
+            record_file = argv[++arg];
+        }
+        else if (arg + 1 < argc - 1 && strcmp(argv[arg], "-p") == 0) {
+            play_file = argv[++arg];
+        }
+        else if (arg + 1 < argc - 1 && strcmp(argv[arg], "-s") == 0) {
+            arg++;
+            ips_set = 1;
+            if (strcmp(argv[arg], "max") == 0) {
+                ips = CHIP8_IPS_UNLIMITED;
+            }
+            else {
+                // every frame needs at least one cycle for its timer tick, and its
+                // budget has to fit an int
+                char* end;
+                errno = 0;
+                ips = strtoull(argv[arg], &end, 10);
+                if (!isdigit((unsigned char)argv[arg][0]) || *end != '\0' || errno != 0
+                    || ips < 60 || ips > CHIP8_IPS_MAX(60)) {
+                    fprintf(stderr, "-s takes max or from 60 to %llu instructions per second\n",
+                        (unsigned long long)CHIP8_IPS_MAX(60));
+                    return 1;
+                }
+            }
+        }
+        else if (strcmp(argv[arg], "-w") == 0) {
+            display_wait = 0;
+        }
+        else if (strcmp(argv[arg], "-t") == 0) {
+            print_timing = 1;
+        }
+        else {
+            break;
+        }
+    }
+    if (arg != argc - 1 || (record_file && play_file)) {
+        fprintf(stderr, "Usage: %s [-r movie | -p movie] [-s ips | -s max] [-w] [-t] <rom_file>\n", argv[0]);
         return 1;
     }
 
+    Emulation emu;
+    emu.frame = 0;
+    emu.keys_held = 0;
+    emu.keys_queued = 0;
+    emu.recording = record_file != NULL;
+    emu.playing = play_file != NULL;
+
     // initialize Chip8
-    Chip8 chip8;
-    chip8_init(&chip8);
+    chip8_init(&emu.chip8);
 
     // load chip8 into memory
-    load_rom(&chip8, argv[1]);
+    load_rom(&emu.chip8, argv[argc - 1]);
+
+    // movies store whole cycles per frame and always run with the display wait
+    if ((record_file || play_file) && (ips == CHIP8_IPS_UNLIMITED || ips % 60 != 0 || !display_wait)) {
+        fprintf(stderr, "movies need -s to be a multiple of 60 and the display wait on\n");
+        return 1;
+    }
+
+    emu.movie = NULL;
+    if (record_file) {
+        emu.movie = chip8_movie_create(&emu.chip8, (int)(ips / 60));
+        if (emu.movie == NULL) {
+            fprintf(stderr, "failed to allocate the movie\n");
+            return 1;
+        }
+    }
+    if (play_file) {
+        emu.movie = chip8_movie_load(play_file);
+        if (emu.movie == NULL) {
+            fprintf(stderr, "failed to load movie: %s\n", play_file);
+            return 1;
+        }
+        // plays at the speed it was recorded at unless told otherwise
+        if (!ips_set) {
+            ips = (uint64_t)chip8_movie_cycles_per_frame(emu.movie) * 60;
+        }
+        if (chip8_movie_start(emu.movie, &emu.chip8) != 0 || (uint64_t)chip8_movie_cycles_per_frame(emu.movie) * 60 != ips) {
+            fprintf(stderr, "%s was recorded with a different ROM or speed\n", play_file);
+            return 1;
+        }
+    }
+
+    // key changes from the window, applied at instruction boundaries
+    emu.input = chip8_input_create();
+    if (emu.input == NULL) {
+        fprintf(stderr, "failed to allocate the input queue\n");
+        return 1;
+    }
+
+    // timers, the display wait and queued keys all go by emulated cycles
+    // the governor sets the tick length frame by frame
+    chip8_governor_init(&emu.governor, ips, 60);
+    chip8_sched_init(&emu.sched, 1);
+    emu.sched.display_wait = display_wait;
+    // a movie only stores the keys each frame starts with, so while recording
+    // or playing keys only change between frames, never in the middle of one
+    emu.sched.input = record_file || play_file ? NULL : emu.input;
+
+    // every frame is recorded so holding backspace can step back through them
+    emu.history = chip8_rewind_create(REWIND_BYTES);
+    if (emu.history == NULL) {
+        fprintf(stderr, "failed to allocate the rewind buffer\n");
+        return 1;
+    }
+
+    emu.frames = chip8_triple_create();
+    if (emu.frames == NULL) {
+        fprintf(stderr, "failed to allocate the frame buffers\n");
+        return 1;
+    }
 
     // initialize glfw
     if (!glfwInit()) {
@@ -73,489 +366,78 @@ int main(int argc, char* argv[]) {
 
     // make context current for calling thread
     glfwMakeContextCurrent(window);
+    // swaps wait for the vertical blank, only this thread waits with them
+    glfwSwapInterval(1);
 
     // opengl intialization
     glViewport(0, 0, 640, 320);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, 640, 320, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    Chip8Renderer* renderer = chip8_render_create();
+    if (renderer == NULL) {
+        fprintf(stderr, "failed to create the display texture\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwSetWindowUserPointer(window, &emu);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
     glfwSetKeyCallback(window, key_callback);
 
-    double prev_time = glfwGetTime();
-    // 60hz frame rate
-    const double frame_time = 1.0 / 60.0;
-
-    // 600 instructions per second
-    const int cycles_per_frame = 10;
+    atomic_init(&emu.running, 1);
+    atomic_init(&emu.rewinding, 0);
+    atomic_init(&emu.turbo, 0);
+    pthread_t emulation_thread;
+    if (pthread_create(&emulation_thread, NULL, emulate, &emu) != 0) {
+        fprintf(stderr, "failed to start the emulation thread\n");
+        glfwTerminate();
+        return 1;
+    }
 
-    // emulation infinite loop
+    // window loop, shows the newest finished frame
     while(!glfwWindowShouldClose(window)) {
-
-        // get difference between time
-        double current_time = glfwGetTime();
-        double delta_time = current_time - prev_time;
-
-        // temp variables for underflow and carry in arithmetic instructions
-        int underflow;
-        int carry;
-
-        // set to 1 if draw instruction is called
-        int display_wait = 0;
-
-        // decrement delay timer
-        if (chip8.delay_timer > 0) {
-            chip8.delay_timer--;
-        }   
-
-        // run 10 cycles per frame
-        for (int i = 0; i < cycles_per_frame; i++) {
-
-            // fetch
-            uint16_t opcode = FETCH_OPCODE();
-            
-            // increment program counter
-            chip8.pc += 2;
-
-            // decode and execute
-            switch (opcode & 0xF000) {
-                // clear
-                case 0x0000:
-                    switch (opcode & 0x00FF) {
-                        case 0x00E0:
-                            // clears the display by setting the display 2d array to 0
-                            // sets the next display size bytes of the display memory block to zero
-                            memset(chip8.display, 0x0, sizeof(chip8.display));
-                            break;
-                        case 0x00EE:
-                            // pop the last address from stack and set pc to it
-                            chip8.pc = chip8_pop(&chip8);
-                            break;
-                    break;
-                    }
-                    break;
-
-                // jump
-                case 0x1000:
-                    // sets the program counter to the address given by NNN
-                    chip8.pc = EXTRACT_NNN(opcode);
-                    break;
-
-                // subroutine
-                case 0x2000: 
-                    // calls subroutine at memory location NNN
-                    // first, pushes the current PC to the stack
-                    chip8_push(&chip8, chip8.pc);
-                    chip8.pc = EXTRACT_NNN(opcode);
-                    break;
-
-                // skip one instruction if VX == NN
-                case 0x3000:
-                    if (chip8.V[EXTRACT_X(opcode)] == EXTRACT_NN(opcode)) {
-                        chip8.pc += 2;
-                    }
-                    break;
-
-                // skip one instruction if VX != NN
-                case 0x4000:
-                    if (chip8.V[EXTRACT_X(opcode)] != EXTRACT_NN(opcode)) {
-                        chip8.pc += 2;
-                    }
-                    break;
-
-                // skip one instruction if VX == VY
-                case 0x5000:
-                    if (chip8.V[EXTRACT_X(opcode)] == chip8.V[EXTRACT_Y(opcode)]) {
-                        chip8.pc += 2;
-                    }
-                    break;
-
-                // skip one instruction if VX != VY
-                case 0x9000:
-                    if (chip8.V[EXTRACT_X(opcode)] != chip8.V[EXTRACT_Y(opcode)]) {
-                        chip8.pc += 2;
-                    }
-                    break;
-
-                // set vx
-                case 0x6000:
-                    // sets the register vx to the value nn
-                    chip8.V[EXTRACT_X(opcode)] = EXTRACT_NN(opcode);
-                    break;
-
-                // add to vx
-                case 0x7000:
-                    // adds nn to register vx
-                    chip8.V[EXTRACT_X(opcode)] += EXTRACT_NN(opcode);
-                    break;
-
-                // logical instructions
-                case 0x8000:
-                    switch (EXTRACT_N(opcode)) {
-                        // set
-                        case 0x0000:
-                            // set VX to VY
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_Y(opcode)];
-                            break;
-
-                        // ON ORIGINAL CHIP-8, OR, AND, XOR SET VF TO 0 
-                        // binary or
-                        case 0x0001:
-                            // vx is set to vx | vy
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_X(opcode)] | chip8.V[EXTRACT_Y(opcode)];
-                            chip8.V[0xF] = 0;
-                            break;
-
-                        // binary and
-                        case 0x0002:
-                            // vx is set to vx & vy
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_X(opcode)] & chip8.V[EXTRACT_Y(opcode)];
-                            chip8.V[0xF] = 0;
-                            break;
-
-                        // logical xor
-                        case 0x0003:
-                            // vx is set to vx ^ vy
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_X(opcode)] ^ chip8.V[EXTRACT_Y(opcode)];
-                            chip8.V[0xF] = 0;
-                            break;
-
-                        case 0x0004:
-                            // if vy + vx is > 255, then vf set to 1
-                            if (chip8.V[EXTRACT_X(opcode)] + chip8.V[EXTRACT_Y(opcode)] > 255) {
-                                underflow = 1;
-                            }
-                            else underflow = 0;
-
-                            // add vy to vx
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_X(opcode)] + chip8.V[EXTRACT_Y(opcode)];
-
-                            if (underflow) {
-                                chip8.V[0xF] = 1;
-                            }
-                            else chip8.V[0xF] = 0;
-
-                            break;
-
-                        // subtract
-                        case 0x0005:
-                            // if vx is larger than vy, then vf is set to 1, else vf is set to 0
-                            
-                            if (chip8.V[EXTRACT_X(opcode)] < chip8.V[EXTRACT_Y(opcode)]) {
-                                underflow = 0;
-                            }
-                            else underflow = 1;
-                                
-                            // vx is set to vx-vy
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_X(opcode)] - chip8.V[EXTRACT_Y(opcode)];
-                            
-                            if (underflow) {
-                                chip8.V[0xF] = 1;
-                            }
-                            else chip8.V[0xF] = 0;
-
-                            break;
-
-                        // subtract
-                        case 0x0007:
-                            
-                            // if vy is larger than vx, then vf is set to 1, else vf is set to 0
-                            if (chip8.V[EXTRACT_Y(opcode)] < chip8.V[EXTRACT_X(opcode)]) {
-                                underflow = 0;
-                            }
-                            else underflow = 1;
-                            // vx is set to vy-vx
-                            chip8.V[EXTRACT_X(opcode)] = chip8.V[EXTRACT_Y(opcode)] - chip8.V[EXTRACT_X(opcode)];
-                            
-                            if (underflow) {
-                                chip8.V[0xF] = 1;
-                            }
-                            else chip8.V[0xF] = 0;
-
-                            break;
-
-                        // shift
-                        // using old behavior here, where vx is set to vy first
-                        case 0x0006:
-
-                            // set VF to the least significant bit of VX
-                            carry = chip8.V[EXTRACT_X(opcode)] & 0x01;
-                            // shift VX to the right by 1 bit
-                            chip8.V[EXTRACT_X(opcode)] >>= 1;
-
-                            chip8.V[0xF] = carry;
-                            break;
-
-                        case 0x000E:                            
-
-                            // set VF to the most significant bit of VX
-                            carry = (chip8.V[EXTRACT_X(opcode)] & 0x80) >> 7;
-                            // shift VX to the left by 1 bit
-                            chip8.V[EXTRACT_X(opcode)] <<= 1;
-
-                            chip8.V[0xF] = carry;
-                            break;
-                    }
-                    break;
-
-                // jump with offset
-                case 0xB000:
-                    chip8.pc = chip8.V[0] + EXTRACT_NNN(opcode);
-                    break;
-
-                // random number
-                case 0xC000:
-                    // generate a random number and binary and with NN
-                    // store value into vx
-                    ;
-                    int r = rand() % 99; 
-                    r = r & EXTRACT_NN(opcode);
-                    chip8.V[EXTRACT_X(opcode)] = r;
-                    break;
-
-                // set I
-                case 0xA000:
-                    // set index register I to NNN
-                    chip8.I = EXTRACT_NNN(opcode);
-                    break;
-
-                // draw
-                case 0xD000: {
-                    // draw sprite at coordinate (VX, VY) with N bytes of sprite data starting at the address stored in I
-
-                    // extract x, y, and n
-                    // modulo by 64 and 32 so position can wrap
-                    uint8_t x = chip8.V[EXTRACT_X(opcode)] % 64;
-                    uint8_t y = chip8.V[EXTRACT_Y(opcode)] % 32;
-                    uint8_t n = EXTRACT_N(opcode);
-
-                    // set displaywait to 1
-                    display_wait = 1;
-
-                    // set register vf to 0
-                    chip8.V[0xF] = 0;
-
-                    // loops through n rows
-                    for (int row = 0; row < n; row++) {
-                        // get the nth byte of sprite data from memory (starts at I)
-                        uint8_t sprite_byte = chip8.memory[chip8.I + row];
-
-                        // loop through each 8 pixels of the sprite row
-                        for (int col = 0; col < 8; col++) {
-                            // get the current screen pixel
-                            // initialize as a pointer to the memory address of the coordinates of the screen given
-                            // by the sprite starting position, offset by the row and column
-                            uint32_t* screen_pixel = &chip8.display[(y + row)][(x + col)];
-
-                            // check to see if the sprite pixel is on
-                            if ((sprite_byte & (0x80 >> col))) {
-                                // then, if the associated screen pixel is also on, set the VF register to 1
-                                // also turn the pixel off
-                                if (*screen_pixel == 0xFF) {
-                                    *screen_pixel = 0x00;
-                                    chip8.V[0xF] = 1;
-                                }
-                                // otherwise, set the screen pixel on
-                                else {
-                                    *screen_pixel = 0xFF;
-                                }
-                            }
-
-                            // hitting the right edge of the screen will stop drawing the current row
-                            if (x + col >= 64) {
-                                break;
-                            }                            
-                        }
-    
-                        // reaching the bottom of the screen will stop
-                        if (y + row >= 32) {
-                            break;
-                        }
-                        
-                    }
-                    break;
-                }
-
-                // skip if key
-                case 0xE000:
-                    switch (opcode & 0x00FF) {
-                        // valid keys 0-F
-                        case 0x009E:
-                            // skip an instruction if the key corresponding to the value in vx is pressed
-                            if (keys[chip8.V[EXTRACT_X(opcode)]]) {
-                                chip8.pc += 2;
-                            }
-                            break;
-                        case 0x00A1:
-                            // skip an instruction if the key corresponding to the value in vx is not pressed
-                            if (!keys[chip8.V[EXTRACT_X(opcode)]]) {
-                                chip8.pc += 2;
-                            }
-                            break;
-                    }
-                
-                // timer keys
-                case 0xF000:
-                    switch (opcode & 0x00FF) {
-                        case 0x0007:
-                            // sets vx to the current value of the delay timer
-                            chip8.V[EXTRACT_X(opcode)] = chip8.delay_timer;
-                            break;
-                        case 0x0015:
-                            // sets delay timer to vx
-                            chip8.delay_timer = chip8.V[EXTRACT_X(opcode)];
-                            break;
-                        case 0x0018:
-                            // sets sound timer to vx
-                            chip8.sound_timer = chip8.V[EXTRACT_X(opcode)];
-                            break;
-                        
-                        case 0x001E:
-                            // add vx to register I
-                            chip8.I += chip8.V[EXTRACT_X(opcode)];
-                            break;
-
-                        // get key
-                        case 0x000A:
-                            // stop instructions
-                            // aka decrement pc, unless a key is pressed
-                            // timers should still decrease
-                            // if key is pressed while this is waiting for input,
-                            // put hexadecimal value into vx and continue
-                            ;
-                            chip8.pc -= 2;
-                            while (1) {
-                                // check if any key is pressed
-                                for (int i = 0; i < 16; i++) {
-                                    if (keys[i]) {
-                                        // wait for the key to be released
-                                        while (keys[i]) {
-                                            // update the delay and sound timers
-                                            if (chip8.delay_timer > 0) {
-                                                chip8.delay_timer--;
-                                            }
-                                            if (chip8.sound_timer > 0) {
-                                                chip8.sound_timer--;
-                                            }
-
-                                            // yield the CPU to allow other events to be processed
-                                            glfwWaitEventsTimeout(0.016); // approximately 60hz
-                                        }
-
-                                        // store the key value in the register and resume execution
-                                        chip8.V[EXTRACT_X(opcode)] = i;
-                                        chip8.pc += 2;
-                                        break;
-                                    }
-                                }
-
-                                // if no key is pressed, update the timers and yield the CPU
-                                if (chip8.pc == opcode - 2) {
-                                    if (chip8.delay_timer > 0) {
-                                        chip8.delay_timer--;
-                                    }
-                                    if (chip8.sound_timer > 0) {
-                                        chip8.sound_timer--;
-                                    }
-                                    glfwWaitEventsTimeout(0.016);
-                                } else {
-                                    break;
-                                }
-                            }
-                            break;
-                        
-                        // font
-                        case 0x0029:
-                            // index register I is set to address of hexadecimal character stored in vx
-                            // point I to the right font memory address 
-                            chip8.I = 0x050 + (chip8.V[EXTRACT_X(opcode)] * 5);
-                            break;
-                        
-                        // binary coded decimal conversion
-                        case 0x0033:
-                            // take number in vx and convert to three digit decimal
-                            // store at memory address I, I+1, I+2
-                            ;
-                            uint8_t value = chip8.V[EXTRACT_X(opcode)];
-                            chip8.memory[chip8.I + 2] = value % 10;
-                            value /= 10;
-                            chip8.memory[chip8.I + 1] = value % 10;
-                            value /= 10;
-                            chip8.memory[chip8.I] = value % 10;
-                            break;
-
-                        // store and load memory
-                        // use a temp value for indexing
-
-                        // OLD BEHAVIOR INCREMENTS I
-                        // will not implement here for sake of testing roms
-                        case 0x0055:
-                            // from registers v0 to vx (get x)
-                            // the values of them will be stored in
-                            // I, I+1, I+X
-                            for (int i = 0; i <= EXTRACT_X(opcode); i++) {
-                                chip8.memory[chip8.I + i] = chip8.V[i];
-                                // chip8.I++;
-                            }
-                            break;
-                        case 0x0065:
-                            // from memory address I, store the 
-                            // values in those addresses into
-                            // registers v0 to vx
-                            for (int i = 0; i <= EXTRACT_X(opcode); i++) {
-                                chip8.V[i] = chip8.memory[chip8.I + i];
-                                // chip8.I++;
-                            }
-                            break;
-                    }
-                
-
-            }
-
-            // implement display wait quirk
-            // break the cycle per frame loop after a draw
-            if (display_wait) {
-                break;
-            }
-
+        // sleeps until a key, the window system or a new frame wakes it
+        // keys left over from a full queue are retried every 60th of a second,
+        // a stalled emulation thread doesn't post frames to wake this one up
+        if (send_keys(&emu)) {
+            glfwWaitEventsTimeout(1.0 / 60);
         }
-
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // render the CHIP-8 display using triangles
-        glBegin(GL_TRIANGLES);
-        for (int y = 0; y < 32; y++) {
-            for (int x = 0; x < 64; x++) {
-                if (chip8.display[y][x]) {
-                    // scale the pixel size to 10x10 (adjust as needed)
-                    // going to be defining triangles 
-                    // top left triangle
-                    glVertex2i(x * 10, y * 10);
-                    glVertex2i(x * 10 + 10, y * 10);
-                    glVertex2i(x * 10, y * 10 + 10);
-
-                    // bottom right triangle
-                    glVertex2i(x * 10 + 10, y * 10);
-                    glVertex2i(x * 10 + 10, y * 10 + 10);
-                    glVertex2i(x * 10, y * 10 + 10);
-                }
-            }
+        else {
+            glfwWaitEvents();
         }
-        glEnd();
-        glfwSwapBuffers(window);
 
-        if (delta_time < frame_time) {
-            double sleep_time = frame_time - delta_time;
-            glfwWaitEventsTimeout(sleep_time);
+        // a frame where no row changed and nothing covered the window needs no
+        // upload, draw or swap, the last one presented is still up
+        // the quad covers the whole window, so there's nothing to clear
+        Chip8Frame* shown = chip8_triple_take(emu.frames);
+        int changed = shown != NULL && chip8_render_update(renderer, shown->display, shown->dirty_rows);
+        if (changed || window_damaged) {
+            chip8_render_draw(renderer);
+            glfwSwapBuffers(window);
+            window_damaged = 0;
         }
+    }
 
-        prev_time = current_time;
+    atomic_store_explicit(&emu.running, 0, memory_order_relaxed);
+    pthread_join(emulation_thread, NULL);
 
+    // end glfw clean, the texture goes with the context
+    chip8_render_destroy(renderer);
+    glfwTerminate();
+    chip8_triple_destroy(emu.frames);
+    chip8_rewind_destroy(emu.history);
+    chip8_input_destroy(emu.input);
+
+    // how closely the emulation thread kept to 60hz
+    if (print_timing) {
+        chip8_pace_print(&emu.pace, stderr);
+        chip8_governor_print(&emu.governor, stderr);
     }
 
-    // end glfw clean
-    glfwTerminate();
+    if (record_file) {
+        chip8_movie_set_frames(emu.movie, emu.frame);
+        if (chip8_movie_save(emu.movie, record_file) != 0) {
+            fprintf(stderr, "failed to save movie: %s\n", record_file);
+        }
+    }
+    chip8_movie_destroy(emu.movie);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./chip8.h"
+#include "./chip8_ops.h"
+
+// ahead of time recompiler
+// reads a ROM, recovers the code reachable from 0x200 and writes a C file with one
+// label per instruction, linked against recomp_run.c
+//
+// each instruction calls the inline handler from chip8_ops.h with a constant opcode,
+// so the C compiler folds the decode away, and direct jumps, calls and skips become gotos
+// returns and BNNN go through a switch on pc, anything not recovered goes to chip8_step
+// if an FX33 or FX55 appears anywhere in the ROM, reached or not, every instruction checks that its bytes
+// still match the ROM first and falls back to chip8_step when they don't
+
+// handler function names in CHIP8_OPS order
+#define CHIP8_OP_FN_NAME(name, fn) #fn,
+static const char* const op_fn_names[CHIP8_OP_COUNT] = {
+    CHIP8_OPS(CHIP8_OP_FN_NAME)
+};
+#undef CHIP8_OP_FN_NAME
+
+static uint8_t memory[4096];
+static int rom_end;
+
+// 1 for every address found to hold reachable code
+static uint8_t reachable[4096];
+
+static uint16_t opcode_at(int addr) {
+    return memory[addr] << 8 | memory[addr + 1];
+}
+
+// an address we can translate, inside the loaded ROM
+static int in_rom(int addr) {
+    return addr >= 0x200 && addr + 1 < rom_end;
+}
+
+// control flow analysis
+// walks every path from 0x200, BNNN targets depend on V0 so they stay unknown
+static void find_code(void) {
+    static uint16_t worklist[4096];
+    int count = 0;
+
+    worklist[count++] = 0x200;
+    while (count > 0) {
+        int addr = worklist[--count];
+        if (!in_rom(addr) || reachable[addr]) {
+            continue;
+        }
+        reachable[addr] = 1;
+
+        uint16_t opcode = opcode_at(addr);
+        Chip8Op op = chip8_decode_op(opcode);
+        int next[2];
+        int n = 0;
+
+        switch (op) {
+            case CHIP8_OP_1NNN:
+                next[n++] = EXTRACT_NNN(opcode);
+                break;
+            case CHIP8_OP_2NNN:
+                // the return lands on the next instruction
+                next[n++] = EXTRACT_NNN(opcode);
+                next[n++] = addr + 2;
+                break;
+            case CHIP8_OP_00EE:
+            case CHIP8_OP_BNNN:
+                break;
+            case CHIP8_OP_3XNN:
+            case CHIP8_OP_4XNN:
+            case CHIP8_OP_5XY0:
+            case CHIP8_OP_9XY0:
+            case CHIP8_OP_EX9E:
+            case CHIP8_OP_EXA1:
+                next[n++] = addr + 2;
+                next[n++] = addr + 4;
+                break;
+            default:
+                next[n++] = addr + 2;
+                break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (in_rom(next[i]) && !reachable[next[i]]) {
+                worklist[count++] = next[i];
+            }
+        }
+    }
+}
+
+// a store anywhere means the code may change under us
+// code reached through BNNN or the interpreter fallback was never walked, so every
+// ROM address is checked, odd ones too, rather than only the recovered instructions
+static int has_stores(void) {
+    for (int addr = 0x200; in_rom(addr); addr++) {
+        Chip8Op op = chip8_decode_op(opcode_at(addr));
+        if (op == CHIP8_OP_FX33 || op == CHIP8_OP_FX55) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// goto the label for addr, or the pc switch if it wasn't recovered
+static void emit_goto(FILE* out, int addr) {
+    if (addr >= 0 && addr < 4096 && reachable[addr]) {
+        fprintf(out, "    goto L_%03X;\n", addr);
+    }
+    else {
+        fprintf(out, "    goto dispatch;\n");
+    }
+}
+
+static void emit_instruction(FILE* out, int addr, int guarded) {
+    uint16_t opcode = opcode_at(addr);
+    Chip8Op op = chip8_decode_op(opcode);
+    const char* fn = op_fn_names[op];
+
+    fprintf(out, "L_%03X: // %s\n", addr, chip8_op_name(op));
+    fprintf(out, "    BUDGET(0x%03X);\n", addr);
+    if (guarded) {
+        fprintf(out, "    GUARD(0x%03X, 0x%02X, 0x%02X);\n", addr, opcode >> 8, opcode & 0xFF);
+    }
+    fprintf(out, "    chip8->pc = 0x%03X;\n", addr + 2);
+
+    switch (op) {
+        case CHIP8_OP_1NNN:
+        case CHIP8_OP_2NNN:
+            fprintf(out, "    %s(chip8, 0x%04X);\n", fn, opcode);
+            fprintf(out, "    i++;\n");
+            emit_goto(out, EXTRACT_NNN(opcode));
+            break;
+
+        case CHIP8_OP_00EE:
+        case CHIP8_OP_BNNN:
+            fprintf(out, "    %s(chip8, 0x%04X);\n", fn, opcode);
+            fprintf(out, "    i++;\n");
+            fprintf(out, "    goto dispatch;\n");
+            break;
+
+        case CHIP8_OP_3XNN:
+        case CHIP8_OP_4XNN:
+        case CHIP8_OP_5XY0:
+        case CHIP8_OP_9XY0:
+        case CHIP8_OP_EX9E:
+        case CHIP8_OP_EXA1:
+            fprintf(out, "    %s(chip8, 0x%04X);\n", fn, opcode);
+            fprintf(out, "    i++;\n");
+            fprintf(out, "    if (chip8->pc == 0x%03X) {\n    ", addr + 4);
+            emit_goto(out, addr + 4);
+            fprintf(out, "    }\n");
+            emit_goto(out, addr + 2);
+            break;
+
+        // display wait quirk, stop after the draw
+        case CHIP8_OP_DXYN:
+            fprintf(out, "    %s(chip8, 0x%04X);\n", fn, opcode);
+            fprintf(out, "    i++;\n");
+            fprintf(out, "    status = CHIP8_DRAW;\n");
+            fprintf(out, "    goto done;\n");
+            break;
+
+        case CHIP8_OP_FX0A:
+            fprintf(out, "    if (%s(chip8, 0x%04X) == CHIP8_KEY_WAIT) {\n", fn, opcode);
+            fprintf(out, "        status = CHIP8_KEY_WAIT;\n");
+            fprintf(out, "        goto done;\n");
+            fprintf(out, "    }\n");
+            fprintf(out, "    i++;\n");
+            emit_goto(out, addr + 2);
+            break;
+
+        default:
+            fprintf(out, "    %s(chip8, 0x%04X);\n", fn, opcode);
+            fprintf(out, "    i++;\n");
+            emit_goto(out, addr + 2);
+            break;
+    }
+    fprintf(out, "\n");
+}
+
+// write a file name as the inside of a C string literal, anything but plain
+// printable characters as an octal escape, so no name can end the literal or the
+// line it's on, and ? too so two of them can't make a trigraph
+static void emit_escaped(FILE* out, const char* text) {
+    for (const unsigned char* c = (const unsigned char*)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\' || *c == '?' || *c < 0x20 || *c > 0x7E) {
+            fprintf(out, "\\%03o", *c);
+        }
+        else {
+            fputc(*c, out);
+        }
+    }
+}
+
+static void emit_file(FILE* out, const char* rom_name) {
+    int guarded = has_stores();
+    int count = 0;
+    for (int addr = 0; addr < 4096; addr++) {
+        count += reachable[addr];
+    }
+
+    fprintf(out, "// generated by chip8_recomp from \"");
+    emit_escaped(out, rom_name);
+    fprintf(out, "\", do not edit\n");
+    fprintf(out, "// %d instructions recovered%s\n", count,
+        guarded ? ", the ROM stores to memory so every instruction is guarded" : "");
+    fprintf(out, "#include \"./chip8.h\"\n");
+    fprintf(out, "#include \"./chip8_ops.h\"\n");
+    fprintf(out, "#include \"./recomp.h\"\n\n");
+
+    // the ROM itself, so the runner doesn't need the file
+    fprintf(out, "const char recompiled_name[] = \"");
+    emit_escaped(out, rom_name);
+    fprintf(out, "\";\n");
+    fprintf(out, "const int recompiled_size = %d;\n", rom_end - 0x200);
+    fprintf(out, "const uint8_t recompiled_image[] = {");
+    for (int addr = 0x200; addr < rom_end; addr++) {
+        fprintf(out, "%s0x%02X,", (addr - 0x200) % 16 == 0 ? "\n    " : " ", memory[addr]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "// stop at this address once the budget is spent\n");
+    fprintf(out, "#define BUDGET(addr) if (i >= cycles) { chip8->pc = addr; goto out; }\n\n");
+    fprintf(out, "// hand the address to the interpreter if its bytes were overwritten\n");
+    fprintf(out, "#define GUARD(addr, hi, lo) \\\n");
+    fprintf(out, "    if (chip8->memory[addr] != hi || chip8->memory[addr + 1] != lo) { chip8->pc = addr; goto interp; }\n\n");
+
+    fprintf(out, "Chip8Status recompiled_run_cycles(Chip8* chip8, int cycles, int* executed) {\n");
+    fprintf(out, "    Chip8Status status;\n");
+    fprintf(out, "    int i = 0;\n\n");
+
+    // the pc switch, used on entry and after anything with an unknown target
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    if (i >= cycles) goto out;\n");
+    fprintf(out, "    switch (chip8->pc) {\n");
+    for (int addr = 0; addr < 4096; addr++) {
+        if (reachable[addr]) {
+            fprintf(out, "        case 0x%03X: goto L_%03X;\n", addr, addr);
+        }
+    }
+    fprintf(out, "        default: goto interp;\n");
+    fprintf(out, "    }\n\n");
+
+    // the interpreter fallback runs one instruction
+    fprintf(out, "interp:\n");
+    fprintf(out, "    status = chip8_step(chip8);\n");
+    fprintf(out, "    if (status == CHIP8_KEY_WAIT) goto done;\n");
+    fprintf(out, "    i++;\n");
+    fprintf(out, "    if (status == CHIP8_DRAW) goto done;\n");
+    fprintf(out, "    goto dispatch;\n\n");
+
+    for (int addr = 0; addr < 4096; addr++) {
+        if (reachable[addr]) {
+            emit_instruction(out, addr, guarded);
+        }
+    }
+
+    fprintf(out, "out:\n");
+    fprintf(out, "    status = CHIP8_BUDGET;\n");
+    fprintf(out, "done:\n");
+    fprintf(out, "    if (executed) {\n");
+    fprintf(out, "        *executed = i;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return status;\n");
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <rom_file> <output.c>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open ROM file: %s\n", argv[1]);
+        return 1;
+    }
+    size_t size = fread(&memory[0x200], 1, 4096 - 0x200, file);
+    fclose(file);
+    rom_end = 0x200 + (int)size;
+
+    find_code();
+
+    FILE* out = fopen(argv[2], "w");
+    if (out == NULL) {
+        fprintf(stderr, "failed to open output file: %s\n", argv[2]);
+        return 1;
+    }
+
+    // only the file name goes in the generated code
+    const char* rom_name = strrchr(argv[1], '/');
+    rom_name = rom_name ? rom_name + 1 : argv[1];
+    emit_file(out, rom_name);
+    fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef RECOMP_H
+#define RECOMP_H
+#include <stdint.h>
+#include "./chip8.h"
+
+// interface between a ROM translated by chip8_recomp and recomp_run.c
+
+// the ROM the code was generated from, loaded at 0x200
+extern const char recompiled_name[];
+extern const uint8_t recompiled_image[];
+extern const int recompiled_size;
+
+// run up to the given number of cycles, same contract as chip8_run_cycles
+// addresses that weren't recovered, and code that no longer matches the ROM,
+// run through chip8_step
+Chip8Status recompiled_run_cycles(Chip8* chip8, int cycles, int* executed);
+
+#endif
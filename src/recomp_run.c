@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "./chip8.h"
+#include "./recomp.h"
+
+// runner for a recompiled ROM
+// benchmarks the generated code against the interpreter, or with -x runs both in
+// lockstep and stops at the first frame where their state differs
+
+#define DEFAULT_CYCLES 10000000
+#define DEFAULT_FRAMES 2000
+#define DEFAULT_CYCLES_PER_FRAME 10
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-c cycles | -x frames] [-p cycles_per_frame]\n"
+        "  -c  benchmark this many instructions against the interpreter (default %d)\n"
+        "  -x  run this many frames in lockstep with the interpreter, comparing state (default %d)\n"
+        "  -p  instructions per 60hz timer tick (default %d)\n",
+        name, DEFAULT_CYCLES, DEFAULT_FRAMES, DEFAULT_CYCLES_PER_FRAME);
+}
+
+static void load_image(Chip8* chip8) {
+    chip8_init(chip8);
+    memcpy(&chip8->memory[0x200], recompiled_image, recompiled_size);
+}
+
+// run flat out like chip8_headless -c, returns the number of instructions executed
+static uint64_t run_cycles(Chip8* chip8, Chip8RunFn run, uint64_t cycles, int cycles_per_frame) {
+    uint64_t total = 0;
+    int since_tick = 0;
+
+    while (total < cycles) {
+        int budget = cycles_per_frame - since_tick;
+        if ((uint64_t)budget > cycles - total) {
+            budget = (int)(cycles - total);
+        }
+
+        int executed;
+        Chip8Status status = run(chip8, budget, &executed);
+        total += executed;
+        since_tick += executed;
+
+        if (status == CHIP8_KEY_WAIT) {
+            break;
+        }
+        if (since_tick >= cycles_per_frame) {
+            chip8_tick_timers(chip8);
+            since_tick = 0;
+        }
+    }
+
+    return total;
+}
+
+static int bench(uint64_t cycles, int cycles_per_frame) {
+    static const struct {
+        const char* name;
+        Chip8RunFn run;
+    } runs[] = {
+        { "interpreter", chip8_run_cycles },
+        { "recompiled", recompiled_run_cycles },
+    };
+    uint64_t hashes[2];
+
+    for (int r = 0; r < 2; r++) {
+        Chip8 chip8;
+        load_image(&chip8);
+
+        double start = now_seconds();
+        uint64_t executed = run_cycles(&chip8, runs[r].run, cycles, cycles_per_frame);
+        double elapsed = now_seconds() - start;
+
+        hashes[r] = chip8_display_hash(&chip8);
+        printf("%-12s %s: %llu instructions in %.3f s, %.1f MIPS, display %016llx\n",
+            runs[r].name, recompiled_name, (unsigned long long)executed, elapsed,
+            elapsed > 0 ? executed / elapsed / 1e6 : 0.0, (unsigned long long)hashes[r]);
+    }
+
+    if (hashes[0] != hashes[1]) {
+        printf("display mismatch\n");
+        return 1;
+    }
+    return 0;
+}
+
+// scripted input so key dependent paths run too, a new key mask every 30 frames
+static uint16_t scripted_keys(uint64_t frame) {
+    uint32_t x = (uint32_t)(frame / 30) * 2654435761u;
+    return (uint16_t)(x >> 16) & (uint16_t)(x >> 8);
+}
+
+static int same_state(const Chip8* a, const Chip8* b) {
+    return memcmp(a->V, b->V, sizeof(a->V)) == 0
+        && a->I == b->I
+        && a->pc == b->pc
+        && a->top == b->top
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && a->delay_timer == b->delay_timer
+        && a->sound_timer == b->sound_timer
+        && a->rng == b->rng
+        && a->key_wait == b->key_wait
+        && a->key_wait_key == b->key_wait_key
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && memcmp(a->memory, b->memory, sizeof(a->memory)) == 0;
+}
+
+// run both one frame at a time and compare everything after each frame
+// each side has its own CXNN generator, seeded the same, so they agree on random numbers too
+static int diff(uint64_t frames, int cycles_per_frame) {
+    static Chip8 ref, rec;
+    load_image(&ref);
+    load_image(&rec);
+
+    for (uint64_t f = 0; f < frames; f++) {
+        ref.keys = rec.keys = scripted_keys(f);
+        chip8_tick_timers(&ref);
+        chip8_tick_timers(&rec);
+
+        int ref_executed, rec_executed;
+        Chip8Status ref_status = chip8_run_cycles(&ref, cycles_per_frame, &ref_executed);
+        Chip8Status rec_status = recompiled_run_cycles(&rec, cycles_per_frame, &rec_executed);
+
+        if (ref_status != rec_status || ref_executed != rec_executed || !same_state(&ref, &rec)) {
+            printf("%s: mismatch at frame %llu\n", recompiled_name, (unsigned long long)f);
+            printf("  interpreter: pc %03X I %03X status %d executed %d\n",
+                ref.pc, ref.I, ref_status, ref_executed);
+            printf("  recompiled:  pc %03X I %03X status %d executed %d\n",
+                rec.pc, rec.I, rec_status, rec_executed);
+            return 1;
+        }
+    }
+
+    printf("%s: %llu frames match, display %016llx\n",
+        recompiled_name, (unsigned long long)frames, (unsigned long long)chip8_display_hash(&rec));
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t cycles = DEFAULT_CYCLES;
+    uint64_t frames = 0;
+    int cycles_per_frame = DEFAULT_CYCLES_PER_FRAME;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cycles = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-x") == 0) {
+            frames = DEFAULT_FRAMES;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                frames = strtoull(argv[++i], NULL, 10);
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            cycles_per_frame = atoi(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (cycles_per_frame <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (frames > 0) {
+        return diff(frames, cycles_per_frame);
+    }
+    return bench(cycles, cycles_per_frame);
+}